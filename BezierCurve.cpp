@@ -1,14 +1,24 @@
 #include "BezierCurve.h"
+#include "BezierFlatten.h"
+#include "CurveIntersector.h"
+#include "StrokeOutline.h"
 #include <QJsonObject>
 #include <QJsonArray>
+#include <algorithm>
 #include <cmath>
+#include <limits>
 
 namespace GameFusion {
 
-BezierCurve::BezierCurve(const std::vector<Vector3D>& vertices) : vertices_(vertices) {}
+BezierCurve::BezierCurve(const std::vector<Vector3D>& vertices) {
+    vertices_.reserve(vertices.size());
+    for (const Vector3D& vertex : vertices)
+        vertices_.push_back(vertex.x(), vertex.y());
+}
 
 BezierCurve& BezierCurve::operator+=(const BezierControl& handle) {
     handles_.push_back(handle);
+    invalidateCaches();
     return *this;
 }
 
@@ -17,40 +27,275 @@ void BezierCurve::clear() {
     handles_.clear();
     vertices_.clear();
     strokeProperties_ = StrokeProperties();
+    invalidateCaches();
+}
+
+namespace {
+
+// Cubic segments between consecutive handles (wrapping around when closed)
+void collectSegments(const std::vector<BezierControl>& handles, bool closed, std::vector<CubicBezier>& segments) {
+    segments.clear();
+    if (handles.empty()) return;
+    const size_t count = handles.size() - (closed ? 0 : 1);
+    segments.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        const BezierControl& h1 = handles[i];
+        const BezierControl& h2 = handles[(i + 1) % handles.size()];
+        segments.push_back({h1.point, h1.point + h1.rightControl, h2.point + h2.leftControl, h2.point});
+    }
 }
 
+} // namespace
+
 void BezierCurve::assess(int stepCount, bool closed) {
+    assessStepCount_ = stepCount;
+    assessClosed_ = closed;
+    buildVertices();
+}
+
+const FlattenBuffer& BezierCurve::vertexArray() const {
+    if (verticesVersion_ != version_)
+        buildVertices();
+    return vertices_;
+}
+
+void BezierCurve::buildVertices() const {
+    verticesVersion_ = version_;
+    if (handles_.empty()) return;   // raw vertices are the curve itself
     vertices_.clear();
-    if (handles_.empty()) return;
-
-    // Generate vertices for each segment
-    for (size_t i = 0; i < handles_.size() - (closed ? 0 : 1); ++i) {
-        const BezierControl& h1 = handles_[i];
-        const BezierControl& h2 = handles_[(i + 1) % handles_.size()];
-
-        Vector3D p1 = h1.point;
-        Vector3D c1 = h1.point + h1.rightControl;
-        Vector3D c2 = h2.point + h2.leftControl;
-        Vector3D p2 = h2.point;
-
-        for (int t = 0; t <= stepCount; ++t) {
-            float u = static_cast<float>(t) / stepCount;
-            float u2 = u * u;
-            float u3 = u2 * u;
-            float mu = 1.0f - u;
-            float mu2 = mu * mu;
-            float mu3 = mu2 * mu;
-
-            // Cubic Bezier interpolation
-            float x = mu3 * p1.x() + 3 * mu2 * u * c1.x() + 3 * mu * u2 * c2.x() + u3 * p2.x();
-            float y = mu3 * p1.y() + 3 * mu2 * u * c1.y() + 3 * mu * u2 * c2.y() + u3 * p2.y();
-            vertices_.emplace_back(x, y, 0.0f);
+
+    // Scratch reused across calls on the same thread
+    thread_local std::vector<CubicBezier> segments;
+
+    // The kernels write straight into the packed vertex arrays
+    const int stepCount = assessStepCount_ < 0 ? strokeProperties_.stepCount : assessStepCount_;
+    collectSegments(handles_, assessClosed_, segments);
+    flattenCubics(segments.data(), segments.size(), stepCount, vertices_);
+
+    if (assessClosed_) {
+        vertices_.push_back(handles_[0].point.x(), handles_[0].point.y()); // Close the loop
+    }
+}
+
+void BezierCurve::assessBatch(std::vector<BezierCurve>& curves) {
+    std::vector<CubicBezier> segments;
+
+    // Sized up front: the kernels' vector slack then never reallocates
+    for (BezierCurve& curve : curves) {
+        const bool layoutChanged = curve.assessStepCount_ >= 0 || curve.assessClosed_;
+        curve.assessStepCount_ = -1;
+        curve.assessClosed_ = false;
+        if (curve.verticesVersion_ == curve.version_ && !layoutChanged)
+            continue;
+        curve.verticesVersion_ = curve.version_;
+        if (curve.handles_.empty())
+            continue;
+        curve.vertices_.clear();
+        const size_t samples = (curve.handles_.size() - 1) * (std::max(curve.strokeProperties_.stepCount, 1) + 1);
+        curve.vertices_.reserve(samples + 8);
+        collectSegments(curve.handles_, false, segments);
+        flattenCubics(segments.data(), segments.size(), curve.strokeProperties_.stepCount, curve.vertices_);
+    }
+}
+
+namespace {
+
+// Half-octave tolerance buckets; a bucket is flattened at its finest tolerance
+int toleranceBucket(float tolerance) {
+    return static_cast<int>(std::floor(std::log2(std::max(tolerance, 1e-3f)) * 2.0f));
+}
+
+float bucketTolerance(int bucket) {
+    return std::exp2(bucket * 0.5f);
+}
+
+// Flattenings kept per curve (typically layer raster, live view, overlays)
+const size_t kFlattenCacheSize = 4;
+
+} // namespace
+
+float BezierCurve::pressureAt(float param) const {
+    if (strokePressure_.empty() || handles_.size() < 2)
+        return -1.0f;
+
+    const int segments = static_cast<int>(handles_.size()) - 1;
+    int segment = std::clamp(static_cast<int>(param), 0, segments - 1);
+    float t = std::clamp(param - segment, 0.0f, 1.0f);
+
+    auto lerp = [this](size_t i, size_t j, float f) {
+        return strokePressure_[i] + (strokePressure_[j] - strokePressure_[i]) * f;
+    };
+
+    if (strokePressure_.size() == handles_.size())
+        return lerp(segment, segment + 1, t);
+
+    // Per-vertex track from assess: stepCount + 1 samples per segment
+    const size_t perSegment = strokePressure_.size() / segments;
+    if (perSegment >= 2 && perSegment * segments == strokePressure_.size()) {
+        float f = t * (perSegment - 1);
+        size_t i = std::min(static_cast<size_t>(f), perSegment - 2);
+        size_t base = segment * perSegment;
+        return lerp(base + i, base + i + 1, f - i);
+    }
+    return -1.0f;
+}
+
+const CurveFlattening& BezierCurve::flatten(float tolerance) const {
+    if (flattenVersion_ != version_) {
+        flattenCache_.clear();
+        flattenVersion_ = version_;
+    }
+    const int bucket = toleranceBucket(tolerance);
+    for (const auto& entry : flattenCache_) {
+        if (entry.first == bucket)
+            return entry.second;
+    }
+
+    CurveFlattening result;
+    if (handles_.size() < 2) {
+        // Single handle is a dot; curves built from raw vertices keep them
+        if (!handles_.empty()) {
+            result.vertices.push_back(handles_[0].point);
+        } else {
+            result.vertices.reserve(vertices_.size());
+            for (size_t i = 0; i < vertices_.size(); ++i)
+                result.vertices.push_back(vertices_.at(i));
         }
+        result.params.assign(result.vertices.size(), 0.0f);
+    } else {
+        const float segmentTolerance = bucketTolerance(bucket);
+        result.vertices.push_back(handles_[0].point);
+        result.params.push_back(0.0f);
+        for (int i = 0; i < segmentCount(); ++i)
+            flattenAdaptive(segment(i), segmentTolerance, result.vertices, result.params, static_cast<float>(i));
+    }
+
+    if (pressureAt(0.0f) >= 0.0f) {
+        result.pressures.reserve(result.params.size());
+        for (float param : result.params)
+            result.pressures.push_back(pressureAt(param));
     }
 
-    if (closed && !handles_.empty()) {
-        vertices_.push_back(handles_[0].point); // Close the loop
+    result.distances.reserve(result.params.size());
+    for (float param : result.params)
+        result.distances.push_back(distanceAtSegmentParam(param));
+
+    if (flattenCache_.size() >= kFlattenCacheSize)
+        flattenCache_.erase(flattenCache_.begin());
+    flattenCache_.emplace_back(bucket, std::move(result));
+    return flattenCache_.back().second;
+}
+
+const QPainterPath& BezierCurve::strokeOutline(float tolerance) const {
+    const int bucket = toleranceBucket(tolerance);
+    if (outlineVersion_ != version_ || outlineBucket_ != bucket) {
+        const CurveFlattening& flat = flatten(tolerance);
+        StrokeOutlineOptions options;
+        options.tolerance = bucketTolerance(bucket);
+        outline_ = buildStrokeOutline(flat.vertices, strokeWidths(flat.vertices, flat.pressures, strokeProperties_, flat.distances), options);
+        outlineBucket_ = bucket;
+        outlineVersion_ = version_;
     }
+    return outline_;
+}
+
+const BBox& BezierCurve::bounds() const {
+    if (boundsVersion_ == version_)
+        return bounds_;
+    boundsVersion_ = version_;
+
+    bounds_ = BBox();
+    auto extend = [this](const BBox& box) {
+        bounds_.minX = std::min(bounds_.minX, box.minX);
+        bounds_.maxX = std::max(bounds_.maxX, box.maxX);
+        bounds_.minY = std::min(bounds_.minY, box.minY);
+        bounds_.maxY = std::max(bounds_.maxY, box.maxY);
+    };
+    auto point = [](float x, float y) {
+        BBox box;
+        box.minX = box.maxX = x;
+        box.minY = box.maxY = y;
+        return box;
+    };
+
+    if (handles_.empty()) {
+        for (size_t i = 0; i < vertices_.size(); ++i)
+            extend(point(vertices_.x[i], vertices_.y[i]));
+    } else if (handles_.size() == 1) {
+        extend(point(handles_[0].point.x(), handles_[0].point.y()));
+    } else {
+        for (int i = 0; i < segmentCount(); ++i)
+            extend(getBBox(segment(i)));
+    }
+    return bounds_;
+}
+
+void BezierCurve::buildArcLengthTable() const {
+    arcParams_.clear();
+    arcLengths_.clear();
+    arcLengthVersion_ = version_;
+    if (handles_.size() < 2) {
+        arcParams_.push_back(0.0f);
+        arcLengths_.push_back(0.0f);
+        return;
+    }
+
+    // Chords of a fine adaptive flattening: the length error is second order
+    // in the chord deviation
+    const float kArcTolerance = 0.02f;
+    std::vector<Vector3D> points;
+    points.push_back(handles_[0].point);
+    arcParams_.push_back(0.0f);
+    for (int i = 0; i < segmentCount(); ++i)
+        flattenAdaptive(segment(i), kArcTolerance, points, arcParams_, static_cast<float>(i));
+
+    arcLengths_.reserve(points.size());
+    double total = 0.0;
+    arcLengths_.push_back(0.0f);
+    for (size_t i = 1; i < points.size(); ++i) {
+        total += std::hypot(points[i].x() - points[i - 1].x(), points[i].y() - points[i - 1].y());
+        arcLengths_.push_back(static_cast<float>(total));
+    }
+}
+
+double BezierCurve::length() const {
+    if (arcLengthVersion_ != version_)
+        buildArcLengthTable();
+    return arcLengths_.back();
+}
+
+float BezierCurve::distanceAtSegmentParam(float param) const {
+    if (arcLengthVersion_ != version_)
+        buildArcLengthTable();
+    if (param <= arcParams_.front())
+        return arcLengths_.front();
+    if (param >= arcParams_.back())
+        return arcLengths_.back();
+
+    size_t i = std::upper_bound(arcParams_.begin(), arcParams_.end(), param) - arcParams_.begin();
+    float f = (param - arcParams_[i - 1]) / (arcParams_[i] - arcParams_[i - 1]);
+    return arcLengths_[i - 1] + (arcLengths_[i] - arcLengths_[i - 1]) * f;
+}
+
+double BezierCurve::distanceAtParam(double t) const {
+    if (handles_.size() < 2)
+        return 0.0;
+    return distanceAtSegmentParam(static_cast<float>(std::clamp(t, 0.0, 1.0) * segmentCount()));
+}
+
+double BezierCurve::paramAtDistance(double distance) const {
+    if (arcLengthVersion_ != version_)
+        buildArcLengthTable();
+    if (handles_.size() < 2 || distance <= 0.0)
+        return 0.0;
+    if (distance >= arcLengths_.back())
+        return 1.0;
+
+    size_t i = std::upper_bound(arcLengths_.begin(), arcLengths_.end(), static_cast<float>(distance)) - arcLengths_.begin();
+    const float span = arcLengths_[i] - arcLengths_[i - 1];
+    const float f = span > 0.0f ? static_cast<float>(distance - arcLengths_[i - 1]) / span : 0.0f;
+    const float param = arcParams_[i - 1] + (arcParams_[i] - arcParams_[i - 1]) * f;
+    return static_cast<double>(param) / segmentCount();
 }
 
 float BezierCurve::GetValue(float startTime, float endTime, float startValue, float endValue,
@@ -119,6 +364,7 @@ void BezierCurve::fromJson(const QJsonObject& json) {
 
     // Load handles
     QJsonArray handlesArray = json["handles"].toArray();
+    handles_.reserve(handlesArray.size());
     for (const auto& handleVal : handlesArray) {
         QJsonObject handleObj = handleVal.toObject();
         QJsonObject pointObj = handleObj["point"].toObject();
@@ -156,9 +402,6 @@ void BezierCurve::fromJson(const QJsonObject& json) {
         );
     strokeProperties_.colorMode = static_cast<StrokeProperties::ColorMode>(
         strokeProps["colorMode"].toInt(0));
-
-    // Re-assess the curve with loaded step count
-    assess(strokeProperties_.stepCount, false);
 }
 
 Vector3D GameFusion::BezierCurve::evaluate(double t) const {
@@ -198,49 +441,6 @@ Vector3D GameFusion::BezierCurve::evaluate(double t) const {
     return u * u * u * P0 + 3 * u * u * localT * C1 + 3 * u * localT * localT * C2 + localT * localT * localT * P3;
 }
 
-// Helper struct for a single cubic Bézier segment
-struct CubicBezier {
-    Vector3D p0, p1, p2, p3;
-
-    Vector3D evaluate(float t) const {
-        float mu = 1.0f - t;
-        float mu2 = mu * mu;
-        float mu3 = mu2 * mu;
-        float t2 = t * t;
-        float t3 = t2 * t;
-        return mu3 * p0 + 3.0f * mu2 * t * p1 + 3.0f * mu * t2 * p2 + t3 * p3;
-    }
-
-    Vector3D derivative(float t) const {
-        float mu = 1.0f - t;
-        return 3.0f * mu * mu * (p1 - p0) + 6.0f * mu * t * (p2 - p1) + 3.0f * t * t * (p3 - p2);
-    }
-
-    std::pair<CubicBezier, CubicBezier> split(float t) const {
-        Vector3D a1 = (1.0f - t) * p0 + t * p1;
-        Vector3D a2 = (1.0f - t) * p1 + t * p2;
-        Vector3D a3 = (1.0f - t) * p2 + t * p3;
-        Vector3D b1 = (1.0f - t) * a1 + t * a2;
-        Vector3D b2 = (1.0f - t) * a2 + t * a3;
-        Vector3D c1 = (1.0f - t) * b1 + t * b2;
-        CubicBezier left{p0, a1, b1, c1};
-        CubicBezier right{c1, b2, a3, p3};
-        return {left, right};
-    }
-};
-
-// Bounding box struct
-struct BBox {
-    float minX = std::numeric_limits<float>::infinity();
-    float maxX = -std::numeric_limits<float>::infinity();
-    float minY = std::numeric_limits<float>::infinity();
-    float maxY = -std::numeric_limits<float>::infinity();
-
-    bool overlaps(const BBox& other) const {
-        return !(maxX < other.minX || other.maxX < minX || maxY < other.minY || other.maxY < minY);
-    }
-};
-
 // Compute bounding box for a cubic Bézier (analytic, no sampling)
 BBox getBBox(const CubicBezier& bez) {
     BBox bbox;
@@ -293,111 +493,20 @@ BBox getBBox(const CubicBezier& bez) {
     return bbox;
 }
 
-// SubCurve for tracking parameter range
-struct SubCurve {
-    CubicBezier curve;
-    float t_min, t_max;
-};
-
-// Refine intersection using Newton-Raphson
-std::pair<float, float> refineIntersection(const CubicBezier& c1, const CubicBezier& c2, float t0, float s0, int max_iter = 10, float tol = 1e-6f) {
-    float t = t0, s = s0;
-    for (int i = 0; i < max_iter; ++i) {
-        Vector3D p1 = c1.evaluate(t);
-        Vector3D p2 = c2.evaluate(s);
-        Vector3D f = p1 - p2;
-        if (f.lengthSquared() < tol) break;
-        Vector3D d1 = c1.derivative(t);
-        Vector3D d2 = c2.derivative(s);
-        float j11 = d1.x(), j12 = -d2.x();
-        float j21 = d1.y(), j22 = -d2.y();
-        float det = j11 * j22 - j12 * j21;
-        if (std::abs(det) < 1e-6f) break;
-        float dx = f.x(), dy = f.y();
-        float dt = (j22 * dx - j12 * dy) / det;
-        float ds = (j11 * dy - j21 * dx) / det;
-        t -= dt;
-        s -= ds;
-        t = std::clamp(t, 0.0f, 1.0f);
-        s = std::clamp(s, 0.0f, 1.0f);
-    }
-    return {t, s};
-}
-
-// Find intersections between two single cubic segments
-std::vector<std::pair<float, float>> findIntersections(const CubicBezier& c1, const CubicBezier& c2, float threshold = 1e-3f, int max_depth = 20) {
-    std::vector<std::pair<float, float>> results;
-    std::function<void(const SubCurve&, const SubCurve&, int)> rec = [&](const SubCurve& sc1, const SubCurve& sc2, int depth) {
-        BBox bb1 = getBBox(sc1.curve);
-        BBox bb2 = getBBox(sc2.curve);
-        if (!bb1.overlaps(bb2)) return;
-        float len1 = sc1.t_max - sc1.t_min;
-        float len2 = sc2.t_max - sc2.t_min;
-        if (depth > max_depth || (len1 < threshold && len2 < threshold)) {
-            float t1 = (sc1.t_min + sc1.t_max) / 2.0f;
-            float t2 = (sc2.t_min + sc2.t_max) / 2.0f;
-            results.emplace_back(t1, t2);
-            return;
-        }
-        float mid1 = (sc1.t_min + sc1.t_max) / 2.0f;
-        auto [l1, r1] = sc1.curve.split(0.5f);
-        SubCurve sl1{l1, sc1.t_min, mid1};
-        SubCurve sr1{r1, mid1, sc1.t_max};
-        float mid2 = (sc2.t_min + sc2.t_max) / 2.0f;
-        auto [l2, r2] = sc2.curve.split(0.5f);
-        SubCurve sl2{l2, sc2.t_min, mid2};
-        SubCurve sr2{r2, mid2, sc2.t_max};
-        rec(sl1, sl2, depth + 1);
-        rec(sl1, sr2, depth + 1);
-        rec(sr1, sl2, depth + 1);
-        rec(sr1, sr2, depth + 1);
-    };
-    SubCurve init1{c1, 0.0f, 1.0f};
-    SubCurve init2{c2, 0.0f, 1.0f};
-    rec(init1, init2, 0);
-    return results;
-}
-
 // Main function to section the curve at intersection
 bool sectionCurveAtIntersection(const BezierCurve& curve, const BezierCurve& other, std::pair<BezierCurve, BezierCurve>& sectioned, IntersectionInfo& info) {
-    size_t num_segs_curve = curve.size() - 1;
-    size_t num_segs_other = other.size() - 1;
-    if (num_segs_curve == 0 || num_segs_other == 0) return false;
-
-    float min_global_t = std::numeric_limits<float>::infinity();
-    Vector3D inter_point;
-    float selected_local_t = -1.0f;
-    size_t selected_seg = -1;
-
-    for (size_t seg1 = 0; seg1 < num_segs_curve; ++seg1) {
-        const BezierControl& h1 = curve[seg1];
-        const BezierControl& h2 = curve[seg1 + 1];
-        CubicBezier cb1{h1.point, h1.point + h1.rightControl, h2.point + h2.leftControl, h2.point};
-
-        for (size_t seg2 = 0; seg2 < num_segs_other; ++seg2) {
-            const BezierControl& oh1 = other[seg2];
-            const BezierControl& oh2 = other[seg2 + 1];
-            CubicBezier cb2{oh1.point, oh1.point + oh1.rightControl, oh2.point + oh2.leftControl, oh2.point};
-
-            auto rough_inters = findIntersections(cb1, cb2);
-            for (auto& rs : rough_inters) {
-                auto [t_local, s_local] = refineIntersection(cb1, cb2, rs.first, rs.second);
-                Vector3D p = cb1.evaluate(t_local);
-                Vector3D q = cb2.evaluate(s_local);
-                if ((p - q).lengthSquared() < 1e-6f) {
-                    float global_t = static_cast<float>(seg1) / static_cast<float>(num_segs_curve) + t_local / static_cast<float>(num_segs_curve);
-                    if (global_t < min_global_t) {
-                        min_global_t = global_t;
-                        inter_point = p;
-                        selected_local_t = t_local;
-                        selected_seg = seg1;
-                    }
-                }
-            }
-        }
-    }
+    size_t num_segs_curve = curve.segmentCount();
+    if (num_segs_curve == 0 || other.segmentCount() == 0) return false;
+
+    // Crossings come sorted along curve; the first one sections it
+    std::vector<CurveCrossing> crossings = CurveIntersector(other).intersect(curve);
+    if (crossings.empty()) return false;
 
-    if (selected_local_t < 0.0f) return false;
+    const CurveCrossing& first_crossing = crossings.front();
+    size_t selected_seg = first_crossing.segment;
+    float selected_local_t = first_crossing.t;
+    Vector3D inter_point = first_crossing.point;
+    float min_global_t = first_crossing.param() / static_cast<float>(num_segs_curve);
 
     // Now split at selected_seg and selected_local_t
     BezierCurve first, second;
@@ -664,8 +773,192 @@ BezierCurve simplifyBezierCurve(const BezierCurve& curve, double threshold) {
     return simplified;
 }
 
+namespace {
+
+// Passes of simplifyBezierCurve tried at commit; each one can at most halve
+// the handle count
+const int kMaxSimplifyPasses = 4;
+
+double distanceToPolyline(const Vector3D& p, const std::vector<Vector3D>& line) {
+    if (line.size() == 1)
+        return (p - line[0]).length();
+    double best = std::numeric_limits<double>::max();
+    for (size_t i = 0; i + 1 < line.size(); ++i) {
+        const double ax = line[i].x(), ay = line[i].y();
+        const double dx = line[i + 1].x() - ax, dy = line[i + 1].y() - ay;
+        const double lengthSq = dx * dx + dy * dy;
+        double t = lengthSq > 0.0 ? ((p.x() - ax) * dx + (p.y() - ay) * dy) / lengthSq : 0.0;
+        t = std::clamp(t, 0.0, 1.0);
+        best = std::min(best, std::hypot(p.x() - (ax + t * dx), p.y() - (ay + t * dy)));
+    }
+    return best;
+}
+
+// Index in original of each handle of simplified. Simplification keeps the
+// anchors it does not remove bit for bit, so they are matched in order.
+bool mapAnchors(const BezierCurve& original, const BezierCurve& simplified, std::vector<int>& map) {
+    map.clear();
+    int j = 0;
+    for (int k = 0; k < simplified.size(); ++k) {
+        const Vector3D& anchor = simplified[k].point;
+        while (j < original.size() && !(original[j].point.x() == anchor.x() && original[j].point.y() == anchor.y()))
+            ++j;
+        if (j == original.size())
+            return false;
+        map.push_back(j++);
+    }
+    return !map.empty() && map.front() == 0 && map.back() == original.size() - 1;
+}
+
+// Largest distance between the two strokes, segment by segment: each
+// simplified segment against the original segments it replaced
+double maxDeviation(const CurveFlattening& originalFlattening, const BezierCurve& simplified,
+                    const std::vector<int>& map, float sampleTolerance) {
+    double deviation = 0.0;
+    std::vector<Vector3D> section;
+    std::vector<Vector3D> replacement;
+    std::vector<float> params;
+    size_t v = 0;
+    for (int k = 0; k + 1 < simplified.size(); ++k) {
+        const float from = float(map[k]);
+        const float to = float(map[k + 1]);
+
+        section.clear();
+        while (v < originalFlattening.params.size() && originalFlattening.params[v] < from)
+            ++v;
+        for (size_t i = v; i < originalFlattening.params.size() && originalFlattening.params[i] <= to; ++i)
+            section.push_back(originalFlattening.vertices[i]);
+
+        replacement.assign(1, simplified[k].point);
+        params.assign(1, 0.0f);
+        flattenAdaptive(simplified.segment(k), sampleTolerance, replacement, params);
+
+        for (const Vector3D& p : section)
+            deviation = std::max(deviation, distanceToPolyline(p, replacement));
+        if (section.empty())
+            continue;
+        for (const Vector3D& p : replacement)
+            deviation = std::max(deviation, distanceToPolyline(p, section));
+    }
+    return deviation;
+}
+
+// Pressure of simplified read off the original track: per handle when the
+// stroke had one value per handle, else stepCount + 1 samples per new segment
+void resamplePressure(const BezierCurve& original, BezierCurve& simplified, const std::vector<int>& map) {
+    const std::vector<float>& track = original.strokePressure();
+    if (track.empty() || original.pressureAt(0.0f) < 0.0f) {
+        simplified.setStrokePressure({});
+        return;
+    }
+
+    std::vector<float> pressures;
+    if (track.size() == size_t(original.size())) {
+        for (int index : map)
+            pressures.push_back(track[index]);
+    } else {
+        const int perSegment = int(track.size()) / original.segmentCount();
+        for (size_t k = 0; k + 1 < map.size(); ++k) {
+            for (int i = 0; i < perSegment; ++i) {
+                // Original params are spread evenly over the replaced segments
+                const float f = float(i) / float(perSegment - 1);
+                const float param = map[k] + f * (map[k + 1] - map[k]);
+                pressures.push_back(original.pressureAt(param));
+            }
+        }
+    }
+    simplified.setStrokePressure(pressures);
+}
+
+} // namespace
+
+BezierCurve simplifyStroke(const BezierCurve& curve, double tolerance) {
+    if (curve.size() < 3 || tolerance <= 0.0)
+        return curve;
+
+    // Sampled finely enough that the flattening error stays small against tolerance
+    const float sampleTolerance = float(tolerance) * 0.25f;
+    const CurveFlattening& flattening = curve.flatten(sampleTolerance);
+
+    BezierCurve best = curve;
+    std::vector<int> bestMap;
+    std::vector<int> map;
+    for (int pass = 0; pass < kMaxSimplifyPasses; ++pass) {
+        BezierCurve candidate = simplifyBezierCurve(best, tolerance * 0.5);
+        if (candidate.size() >= best.size() || !mapAnchors(curve, candidate, map))
+            break;
+        if (maxDeviation(flattening, candidate, map, sampleTolerance) > tolerance)
+            break;
+        best = std::move(candidate);
+        bestMap.swap(map);
+    }
+    if (bestMap.empty())
+        return curve;
+
+    resamplePressure(curve, best, bestMap);
+    return best;
+}
+
+BezierCurve sliceCurve(const BezierCurve& curve, float from, float to) {
+    BezierCurve slice;
+    slice.setStrokeProperties(curve.getStrokeProperties());
+    const int segments = curve.segmentCount();
+    from = std::clamp(from, 0.0f, float(segments));
+    to = std::clamp(to, 0.0f, float(segments));
+    if (segments == 0 || to <= from)
+        return slice;
+
+    // Segments touched, with the local range kept of each
+    const int first = std::min(int(from), segments - 1);
+    const int last = std::min(int(std::ceil(to)) - 1, segments - 1);
+    std::vector<CubicBezier> parts;
+    std::vector<std::pair<float, float>> ranges;
+    for (int i = first; i <= last; ++i) {
+        const float t0 = i == first ? from - i : 0.0f;
+        const float t1 = i == last ? to - i : 1.0f;
+        CubicBezier part = curve.segment(i);
+        if (t1 < 1.0f)
+            part = part.split(t1).first;
+        if (t0 > 0.0f)
+            part = part.split(t0 / t1).second;
+        parts.push_back(part);
+        ranges.emplace_back(i + t0, i + t1);
+    }
+
+    const Vector3D zero(0.0f, 0.0f, 0.0f);
+    slice += BezierControl(parts.front().p0, zero, parts.front().p1 - parts.front().p0);
+    for (size_t k = 1; k < parts.size(); ++k) {
+        BezierControl handle = curve[first + k];
+        handle.point = parts[k].p0;
+        handle.leftControl = parts[k - 1].p2 - parts[k - 1].p3;
+        handle.rightControl = parts[k].p1 - parts[k].p0;
+        slice += handle;
+    }
+    slice += BezierControl(parts.back().p3, parts.back().p2 - parts.back().p3, zero);
+
+    const std::vector<float>& track = curve.strokePressure();
+    if (track.empty() || curve.pressureAt(0.0f) < 0.0f)
+        return slice;
+    std::vector<float> pressures;
+    if (track.size() == size_t(curve.size())) {
+        pressures.push_back(curve.pressureAt(ranges.front().first));
+        for (const auto& range : ranges)
+            pressures.push_back(curve.pressureAt(range.second));
+    } else {
+        const int perSegment = int(track.size()) / segments;
+        const float step = 1.0f / float(std::max(perSegment - 1, 1));
+        for (const auto& [a, b] : ranges) {
+            for (int i = 0; i < perSegment; ++i)
+                pressures.push_back(curve.pressureAt(a + (b - a) * float(i) * step));
+        }
+    }
+    slice.setStrokePressure(pressures);
+    return slice;
+}
+
 void BezierCurve::linearize(bool loop) {
     if (handles_.size() < 2) return; // No-op for <2 points
+    invalidateCaches();
 
     m_isClosed = loop;
 
@@ -708,8 +1001,23 @@ Vector3D BezierCurve::getAnchor(int index) const {
     return handles_[index].point;
 }
 
+Vector3D BezierCurve::tangentAt(int index) const {
+    if (handles_.empty())
+        return Vector3D(1.0f, 0.0f, 0.0f);
+
+    const BezierControl& handle = handles_[index];
+    Vector3D direction = handle.rightControl - handle.leftControl;
+    if (Vector3D::dotProduct(direction, direction) <= 0.0f)
+        direction = getAnchor(index + 1) - getAnchor(index - 1);
+    const float length = std::sqrt(Vector3D::dotProduct(direction, direction));
+    if (length <= 0.0f)
+        return Vector3D(1.0f, 0.0f, 0.0f);
+    return direction / length;
+}
+
 void BezierCurve::smoothAuto(bool loop)
 {
+    invalidateCaches();
 
 
 
@@ -830,6 +1138,7 @@ void BezierCurve::smoothAuto(bool loop)
 
 void BezierCurve::smooth2(float smoothIn, float smoothOut)
 {
+    invalidateCaches();
     //ListIterator <BezierHandle> li(m_handleList);
 
     for(int i=1; i<handles_.size()-1; i++)
@@ -885,6 +1194,7 @@ void BezierCurve::smooth2(float smoothIn, float smoothOut)
 
 void BezierCurve::smooth(float strength, bool loop) {
     if (handles_.size() < 2) return; // No-op for <2 points
+    invalidateCaches();
 
     m_isClosed = loop;
 
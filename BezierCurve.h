@@ -3,8 +3,15 @@
 
 #include <QJsonObject>
 
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <vector>
+#include <limits>
+#include <utility>
 #include <QPointF>
+#include <QPainterPath>
 #include "StrokeProperties.h"
 #include "Vector3D.h"
 
@@ -13,11 +20,17 @@ namespace GameFusion {
 struct StrokePoint {
     QPointF pos;
     float pressure = 1.0f;  // 0.0-1.0
+    qint64 timestamp = 0;   // ms, from the input event
+    float xTilt = 0.0f;     // degrees, pen tilt (0 for mouse)
+    float yTilt = 0.0f;
 };
 
+// Handles are the bulk of a project's resident stroke data, so they hold only
+// what defines the curve: normals are derived on demand (BezierCurve::tangentAt,
+// normalAt) and the modes take a byte each.
 struct BezierControl {
 
-    enum class HandleMode {
+    enum class HandleMode : std::uint8_t {
         AutoSmooth,     // Automatically smoothed tangent
         Linear,         // Straight-line interpolation
         Manual          // Explicitly user-controlled
@@ -27,21 +40,133 @@ struct BezierControl {
     Vector3D leftControl; // Left control point (relative to point)
     Vector3D rightControl; // Right control point (relative to point)
 
-    Vector3D sideNormal; // side normal to the curve
-    Vector3D tangentNormal; // tangent normal to the curve
-
-    int indexPoint = -1;
-
     HandleMode leftMode = HandleMode::Manual;
     HandleMode rightMode = HandleMode::Manual;
 
     BezierControl(const Vector3D& p, const Vector3D& left, const Vector3D& right)
         : point(p), leftControl(left), rightControl(right) {}
 
-    BezierControl(const Vector3D& p, const Vector3D& left, const Vector3D& right, const int indexPoint)
-        : point(p), leftControl(left), rightControl(right), indexPoint(indexPoint) {}
+    // Older callers pass the sample index the handle was fitted at; it is no
+    // longer stored
+    BezierControl(const Vector3D& p, const Vector3D& left, const Vector3D& right, int /*indexPoint*/)
+        : point(p), leftControl(left), rightControl(right) {}
 
     BezierControl(){}
+
+    // The normals older code read as members, derived from the handle's own
+    // controls (BezierCurve::tangentAt also falls back to the neighbours)
+    Vector3D tangentNormal() const {
+        const Vector3D direction = rightControl - leftControl;
+        const float length = std::sqrt(Vector3D::dotProduct(direction, direction));
+        return length > 0.0f ? direction / length : Vector3D(1.0f, 0.0f, 0.0f);
+    }
+    Vector3D sideNormal() const {
+        const Vector3D tangent = tangentNormal();
+        return Vector3D(-tangent.y(), tangent.x(), 0.0f);
+    }
+};
+
+// Helper struct for a single cubic Bézier segment (absolute control points)
+struct CubicBezier {
+    Vector3D p0, p1, p2, p3;
+
+    Vector3D evaluate(float t) const {
+        float mu = 1.0f - t;
+        float mu2 = mu * mu;
+        float mu3 = mu2 * mu;
+        float t2 = t * t;
+        float t3 = t2 * t;
+        return mu3 * p0 + 3.0f * mu2 * t * p1 + 3.0f * mu * t2 * p2 + t3 * p3;
+    }
+
+    Vector3D derivative(float t) const {
+        float mu = 1.0f - t;
+        return 3.0f * mu * mu * (p1 - p0) + 6.0f * mu * t * (p2 - p1) + 3.0f * t * t * (p3 - p2);
+    }
+
+    std::pair<CubicBezier, CubicBezier> split(float t) const {
+        Vector3D a1 = (1.0f - t) * p0 + t * p1;
+        Vector3D a2 = (1.0f - t) * p1 + t * p2;
+        Vector3D a3 = (1.0f - t) * p2 + t * p3;
+        Vector3D b1 = (1.0f - t) * a1 + t * a2;
+        Vector3D b2 = (1.0f - t) * a2 + t * a3;
+        Vector3D c1 = (1.0f - t) * b1 + t * b2;
+        CubicBezier left{p0, a1, b1, c1};
+        CubicBezier right{c1, b2, a3, p3};
+        return {left, right};
+    }
+};
+
+// Bounding box struct
+struct BBox {
+    float minX = std::numeric_limits<float>::infinity();
+    float maxX = -std::numeric_limits<float>::infinity();
+    float minY = std::numeric_limits<float>::infinity();
+    float maxY = -std::numeric_limits<float>::infinity();
+
+    bool overlaps(const BBox& other) const {
+        return !(maxX < other.minX || other.maxX < minX || maxY < other.minY || other.maxY < minY);
+    }
+};
+
+// Compute bounding box for a cubic Bézier (analytic, no sampling)
+BBox getBBox(const CubicBezier& bez);
+
+// Structure-of-arrays 2D sample buffer, filled by the flattening kernels and
+// holding the assessed vertices of a curve
+struct FlattenBuffer {
+    std::vector<float> x;
+    std::vector<float> y;
+
+    size_t size() const { return x.size(); }
+    bool empty() const { return x.empty(); }
+    void clear() { x.clear(); y.clear(); }
+    void reserve(size_t n) { x.reserve(n); y.reserve(n); }
+    void push_back(float px, float py) { x.push_back(px); y.push_back(py); }
+    Vector3D at(size_t i) const { return Vector3D(x[i], y[i], 0.0f); }
+
+    // Read-only view as a sequence of Vector3D, for code written against the
+    // std::vector<Vector3D> vertex array. Elements are returned by value.
+    Vector3D operator[](size_t i) const { return at(i); }
+    Vector3D front() const { return at(0); }
+    Vector3D back() const { return at(size() - 1); }
+    std::vector<Vector3D> toVector() const {
+        std::vector<Vector3D> points;
+        points.reserve(size());
+        for (size_t i = 0; i < size(); ++i)
+            points.push_back(at(i));
+        return points;
+    }
+
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Vector3D;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = Vector3D;
+
+        const_iterator(const FlattenBuffer* buffer, size_t index) : m_buffer(buffer), m_index(index) {}
+        Vector3D operator*() const { return m_buffer->at(m_index); }
+        const_iterator& operator++() { ++m_index; return *this; }
+        const_iterator operator++(int) { const_iterator it = *this; ++m_index; return it; }
+        bool operator==(const const_iterator& other) const { return m_index == other.m_index; }
+        bool operator!=(const const_iterator& other) const { return m_index != other.m_index; }
+
+    private:
+        const FlattenBuffer* m_buffer;
+        size_t m_index;
+    };
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, size()); }
+};
+
+// Adaptive polyline through a curve (see BezierCurve::flatten)
+struct CurveFlattening {
+    std::vector<Vector3D> vertices;
+    std::vector<float> params;      // segment index + local t of each vertex
+    std::vector<float> pressures;   // pressure track resampled at the vertices, empty without one
+    std::vector<float> distances;   // arc length from the start at each vertex
 };
 
 struct IntersectionInfo {
@@ -57,8 +182,10 @@ public:
     // Add a Bezier handle to the curve
     BezierCurve& operator+=(const BezierControl& handle);
 
-    // Subscript operator for accessing handles
+    // Subscript operator for accessing handles. Non-const access counts as an
+    // edit: the caller may write through the reference.
     BezierControl& operator[](size_t index) {
+        invalidateCaches();
         return handles_[index];
     }
     const BezierControl& operator[](size_t index) const {
@@ -68,30 +195,53 @@ public:
     // Clear all vertices and handles
     void clear();
 
-    // Assess the curve, generating vertices for rendering (stepCount: points per segment, closed: loop the curve)
+    // Assess the curve, generating vertices for rendering (stepCount: points per segment, closed: loop the curve).
+    // The layout is kept: vertexArray() re-assesses with it after edits.
     void assess(int stepCount, bool closed);
 
-    // Get the vertex array for rendering
-    std::vector<Vector3D>& vertexArray() { return vertices_; }
-    const std::vector<Vector3D>& vertexArray() const { return vertices_; }
+    // Assess the stale curves of a stroke list up front (open, each at its own
+    // stepCount) through one shared segment buffer
+    static void assessBatch(std::vector<BezierCurve>& curves);
 
-    std::vector<float> strokePressure(){return strokePressure_;}
-    std::vector<float> strokePressure() const {return strokePressure_;}
+    // Assessed vertices, packed 2D (x and y arrays). Computed on first use
+    // after a change, at the stroke's stepCount unless assess() set a layout.
+    const FlattenBuffer& vertexArray() const;
+
+    const std::vector<float>& strokePressure() const {return strokePressure_;}
+
+    // Polyline through the handles whose chords stay within tolerance of the
+    // curve, subdivided by flatness so straight runs get few vertices and tight
+    // turns many. Cached per tolerance bucket (half octaves) until the curve changes.
+    const CurveFlattening& flatten(float tolerance) const;
+
+    // Filled envelope of the stroke (variable width modes), tessellated from the
+    // adaptive flattening at tolerance and cached until the curve changes
+    const QPainterPath& strokeOutline(float tolerance = 0.25f) const;
 
     // Static method to interpolate a value along the curve (for animation)
     static float GetValue(float startTime, float endTime, float startValue, float endValue,
                           float control1, float control2, float currentTime);
 
-    // JSON serialization (for integration with Layer)
+    // JSON serialization (for integration with Layer). Loading only reads the
+    // handles and properties; geometry is derived when first asked for.
     void toJson(QJsonObject& json) const;
     void fromJson(const QJsonObject& json);
 
     int size() const {return handles_.size();}
     bool empty() const {return handles_.empty();}
 
+    // Cubic segments between consecutive handles
+    int segmentCount() const { return handles_.size() < 2 ? 0 : int(handles_.size()) - 1; }
+    CubicBezier segment(int index) const {
+        const BezierControl& a = handles_[index];
+        const BezierControl& b = handles_[index + 1];
+        return {a.point, a.point + a.rightControl, b.point + b.leftControl, b.point};
+    }
+
     // Get and set stroke properties
     void setStrokeProperties(const StrokeProperties& props) {
         strokeProperties_ = props;
+        invalidateCaches();
     }
     const StrokeProperties& getStrokeProperties() const {
         return strokeProperties_;
@@ -99,18 +249,45 @@ public:
 
     void setStrokePressure(const std::vector<float> pressureData){
         strokePressure_ = pressureData;
+        invalidateCaches();
     }
 
-    // Iterator support
-    auto begin() { return handles_.begin(); }
+    // Pressure at a flattening param, from a per-handle or per-vertex (assess
+    // layout) pressure track; -1 when there is no usable track
+    float pressureAt(float param) const;
+
+    // Iterator support (non-const iteration counts as an edit)
+    auto begin() { invalidateCaches(); return handles_.begin(); }
     auto end() { return handles_.end(); }
     auto begin() const { return handles_.begin(); }
     auto end() const { return handles_.end(); }
 
     Vector3D evaluate(double t) const;
 
+    // Modification counter, bumped by every change to the handles, pressure or
+    // properties. Derived data (vertices, flattenings, bounds, arc-length
+    // table, outline) is stamped with the version it was built at and rebuilt
+    // on first use after a change.
+    std::uint64_t version() const { return version_; }
+
+    // Tight bounds of the curve (of the raw vertices without handles); empty
+    // (min > max) when there is nothing
+    const BBox& bounds() const;
+
+    // Arc-length parameterization, from a table built on first use and kept
+    // until the handles change. t is the global parameter of evaluate().
+    double length() const;
+    double paramAtDistance(double distance) const;
+    double distanceAtParam(double t) const;
+    Vector3D evaluateAtDistance(double distance) const { return evaluate(paramAtDistance(distance)); }
+
     Vector3D getAnchor(int index) const;
 
+    // Unit tangent and side normal at a handle, derived from its controls
+    // (or the neighbouring anchors when both are zero)
+    Vector3D tangentAt(int index) const;
+    Vector3D normalAt(int index) const { return perpendicular(tangentAt(index)); }
+
     // Smoothing: Creates smooth in/out tangents with uniform time spacing *per segment*
     // strength: 0.0 = linear, 1.0 = full smooth (default 0.5)
     void smoothAuto(bool loop=false);
@@ -125,10 +302,32 @@ public:
 
 private:
     std::vector<BezierControl>  handles_; // Control points defining the curve
-    std::vector<Vector3D>       vertices_;    // Generated vertices for rendering
+    mutable FlattenBuffer       vertices_;    // Generated vertices for rendering (the data itself without handles)
     StrokeProperties            strokeProperties_; // Per-stroke attributes
     std::vector<float>          strokePressure_; // tablet pressure
 
+    void invalidateCaches() { ++version_; }
+    void buildVertices() const;
+    void buildArcLengthTable() const;
+    // Table lookup in segment units (segment index + local t)
+    float distanceAtSegmentParam(float param) const;
+
+    std::uint64_t               version_ = 1;   // caches start stale at 0
+    int                         assessStepCount_ = -1;  // -1: the stroke's stepCount
+    bool                        assessClosed_ = false;
+
+    mutable std::uint64_t       verticesVersion_ = 0;
+    mutable QPainterPath        outline_; // cached stroke envelope
+    mutable std::uint64_t       outlineVersion_ = 0;
+    mutable int                 outlineBucket_ = 0;
+    mutable std::vector<std::pair<int, CurveFlattening>> flattenCache_; // by tolerance bucket
+    mutable std::uint64_t       flattenVersion_ = 0;
+    mutable BBox                bounds_;
+    mutable std::uint64_t       boundsVersion_ = 0;
+    mutable std::vector<float>  arcParams_;   // segment index + local t, increasing
+    mutable std::vector<float>  arcLengths_;  // cumulative length at arcParams_
+    mutable std::uint64_t       arcLengthVersion_ = 0;
+
     bool m_isClosed = false;
 };
 
@@ -154,6 +353,17 @@ std::vector<double> chordParams(const std::vector<StrokePoint>& points);
 
 BezierCurve simplifyBezierCurve(const BezierCurve& curve, double threshold);
 
+// Commit-time simplification: simplifyBezierCurve passes repeated while the
+// result stays within tolerance (px) of the original stroke, checked both ways
+// between their flattenings. The pressure track is resampled onto the new
+// handles, per handle or in the assess layout, whichever the stroke had.
+BezierCurve simplifyStroke(const BezierCurve& curve, double tolerance);
+
+// Part of curve between two params (segment index + local t), cut with
+// CubicBezier::split at both ends. Inner handles keep their modes; the
+// pressure track is re-sliced in the layout the curve had.
+BezierCurve sliceCurve(const BezierCurve& curve, float from, float to);
+
 } // namespace GameFusion
 
 
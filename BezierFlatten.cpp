@@ -0,0 +1,247 @@
+#include "BezierFlatten.h"
+
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BEZIER_FLATTEN_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(BEZIER_FLATTEN_X86) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define BEZIER_FLATTEN_SSE2 1
+#endif
+
+#if defined(BEZIER_FLATTEN_X86)
+#define BEZIER_FLATTEN_AVX2 1
+#if defined(__GNUC__) || defined(__clang__)
+#define BEZIER_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define BEZIER_TARGET_AVX2
+#endif
+#endif
+
+namespace GameFusion {
+
+namespace {
+
+// Widest kernel; buffers keep this much slack so the last vector store of a
+// segment may run past its samples
+const int kMaxLanes = 8;
+
+using KernelFunction = void (*)(const CubicBezier& bez, int stepCount, float* xs, float* ys);
+
+// Power basis of one axis: a t^3 + b t^2 + c t + d
+struct Cubic1D {
+    double a, b, c, d;
+
+    Cubic1D(double p0, double p1, double p2, double p3)
+        : a(-p0 + 3.0 * p1 - 3.0 * p2 + p3),
+          b(3.0 * p0 - 6.0 * p1 + 3.0 * p2),
+          c(-3.0 * p0 + 3.0 * p1),
+          d(p0) {}
+
+    double value(double t) const { return ((a * t + b) * t + c) * t + d; }
+
+    // Forward differences for lanes starting at t = lane * h and advancing by
+    // H = lanes * h per iteration (third difference is the same in every lane)
+    void laneDifferences(double h, int lanes, float* p, float* d1, float* d2, float& d3) const {
+        const double H = h * lanes;
+        const double H2 = H * H;
+        const double H3 = H2 * H;
+        for (int k = 0; k < lanes; ++k) {
+            const double t = h * k;
+            p[k] = static_cast<float>(value(t));
+            d1[k] = static_cast<float>(a * (3.0 * t * t * H + 3.0 * t * H2 + H3) + b * (2.0 * t * H + H2) + c * H);
+            d2[k] = static_cast<float>(6.0 * a * H2 * t + 6.0 * a * H3 + 2.0 * b * H2);
+        }
+        d3 = static_cast<float>(6.0 * a * H3);
+    }
+};
+
+void flattenScalar(const CubicBezier& bez, int stepCount, float* xs, float* ys) {
+    const Cubic1D cx(bez.p0.x(), bez.p1.x(), bez.p2.x(), bez.p3.x());
+    const Cubic1D cy(bez.p0.y(), bez.p1.y(), bez.p2.y(), bez.p3.y());
+    const double h = 1.0 / stepCount;
+    for (int i = 0; i <= stepCount; ++i) {
+        xs[i] = static_cast<float>(cx.value(i * h));
+        ys[i] = static_cast<float>(cy.value(i * h));
+    }
+}
+
+#if defined(BEZIER_FLATTEN_SSE2)
+void flattenSSE2(const CubicBezier& bez, int stepCount, float* xs, float* ys) {
+    const Cubic1D cx(bez.p0.x(), bez.p1.x(), bez.p2.x(), bez.p3.x());
+    const Cubic1D cy(bez.p0.y(), bez.p1.y(), bez.p2.y(), bez.p3.y());
+    const double h = 1.0 / stepCount;
+
+    alignas(16) float p[4], d1[4], d2[4];
+    float d3;
+    cx.laneDifferences(h, 4, p, d1, d2, d3);
+    __m128 px = _mm_load_ps(p), d1x = _mm_load_ps(d1), d2x = _mm_load_ps(d2), d3x = _mm_set1_ps(d3);
+    cy.laneDifferences(h, 4, p, d1, d2, d3);
+    __m128 py = _mm_load_ps(p), d1y = _mm_load_ps(d1), d2y = _mm_load_ps(d2), d3y = _mm_set1_ps(d3);
+
+    for (int i = 0; i <= stepCount; i += 4) {
+        _mm_storeu_ps(xs + i, px);
+        _mm_storeu_ps(ys + i, py);
+        px = _mm_add_ps(px, d1x);
+        d1x = _mm_add_ps(d1x, d2x);
+        d2x = _mm_add_ps(d2x, d3x);
+        py = _mm_add_ps(py, d1y);
+        d1y = _mm_add_ps(d1y, d2y);
+        d2y = _mm_add_ps(d2y, d3y);
+    }
+}
+#endif
+
+#if defined(BEZIER_FLATTEN_AVX2)
+BEZIER_TARGET_AVX2
+void flattenAVX2(const CubicBezier& bez, int stepCount, float* xs, float* ys) {
+    const Cubic1D cx(bez.p0.x(), bez.p1.x(), bez.p2.x(), bez.p3.x());
+    const Cubic1D cy(bez.p0.y(), bez.p1.y(), bez.p2.y(), bez.p3.y());
+    const double h = 1.0 / stepCount;
+
+    alignas(32) float p[8], d1[8], d2[8];
+    float d3;
+    cx.laneDifferences(h, 8, p, d1, d2, d3);
+    __m256 px = _mm256_load_ps(p), d1x = _mm256_load_ps(d1), d2x = _mm256_load_ps(d2), d3x = _mm256_set1_ps(d3);
+    cy.laneDifferences(h, 8, p, d1, d2, d3);
+    __m256 py = _mm256_load_ps(p), d1y = _mm256_load_ps(d1), d2y = _mm256_load_ps(d2), d3y = _mm256_set1_ps(d3);
+
+    for (int i = 0; i <= stepCount; i += 8) {
+        _mm256_storeu_ps(xs + i, px);
+        _mm256_storeu_ps(ys + i, py);
+        px = _mm256_add_ps(px, d1x);
+        d1x = _mm256_add_ps(d1x, d2x);
+        d2x = _mm256_add_ps(d2x, d3x);
+        py = _mm256_add_ps(py, d1y);
+        d1y = _mm256_add_ps(d1y, d2y);
+        d2y = _mm256_add_ps(d2y, d3y);
+    }
+}
+
+bool cpuHasAvx2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+FlattenKernel detectKernel() {
+#if defined(BEZIER_FLATTEN_AVX2)
+    if (cpuHasAvx2())
+        return FlattenKernel::AVX2;
+#endif
+#if defined(BEZIER_FLATTEN_SSE2)
+    return FlattenKernel::SSE2;
+#else
+    return FlattenKernel::Scalar;
+#endif
+}
+
+KernelFunction kernelFunction(FlattenKernel kernel) {
+    switch (kernel) {
+#if defined(BEZIER_FLATTEN_AVX2)
+    case FlattenKernel::AVX2:
+        return flattenAVX2;
+#endif
+#if defined(BEZIER_FLATTEN_SSE2)
+    case FlattenKernel::SSE2:
+        return flattenSSE2;
+#endif
+    default:
+        return flattenScalar;
+    }
+}
+
+} // namespace
+
+FlattenKernel flattenKernel() {
+    static const FlattenKernel kernel = detectKernel();
+    return kernel;
+}
+
+void flattenCubics(const CubicBezier* segments, size_t count, int stepCount, FlattenBuffer& out) {
+    if (count == 0) return;
+    if (stepCount < 1) stepCount = 1;
+
+    static const KernelFunction kernel = kernelFunction(flattenKernel());
+
+    const size_t samples = static_cast<size_t>(stepCount) + 1;
+    const size_t start = out.size();
+    const size_t end = start + count * samples;
+
+    // Slack for the last vector store; the next segment overwrites the
+    // overrun of the previous one
+    out.x.resize(end + kMaxLanes);
+    out.y.resize(end + kMaxLanes);
+
+    float* xs = out.x.data() + start;
+    float* ys = out.y.data() + start;
+    for (size_t s = 0; s < count; ++s, xs += samples, ys += samples) {
+        const CubicBezier& bez = segments[s];
+        kernel(bez, stepCount, xs, ys);
+        xs[0] = bez.p0.x();
+        ys[0] = bez.p0.y();
+        xs[stepCount] = bez.p3.x();
+        ys[stepCount] = bez.p3.y();
+    }
+
+    out.x.resize(end);
+    out.y.resize(end);
+}
+
+namespace {
+
+// Piece depth cap: 2^16 pieces per segment is far below any useful tolerance
+const int kMaxAdaptiveDepth = 16;
+
+// Flatness bound of a cubic: 16x the squared max distance of the curve from
+// its chord is below max(ux², vx²) + max(uy², vy²)
+bool isFlat(const CubicBezier& bez, float tolerance16Sq) {
+    float ux = 3.0f * bez.p1.x() - 2.0f * bez.p0.x() - bez.p3.x();
+    float uy = 3.0f * bez.p1.y() - 2.0f * bez.p0.y() - bez.p3.y();
+    float vx = 3.0f * bez.p2.x() - bez.p0.x() - 2.0f * bez.p3.x();
+    float vy = 3.0f * bez.p2.y() - bez.p0.y() - 2.0f * bez.p3.y();
+    return std::max(ux * ux, vx * vx) + std::max(uy * uy, vy * vy) <= tolerance16Sq;
+}
+
+void subdivide(const CubicBezier& bez, float t0, float t1, int depth, float tolerance16Sq,
+               std::vector<Vector3D>& points, std::vector<float>& params, float paramOffset) {
+    if (depth >= kMaxAdaptiveDepth || isFlat(bez, tolerance16Sq)) {
+        points.push_back(bez.p3);
+        params.push_back(paramOffset + t1);
+        return;
+    }
+    const float mid = 0.5f * (t0 + t1);
+    auto halves = bez.split(0.5f);
+    subdivide(halves.first, t0, mid, depth + 1, tolerance16Sq, points, params, paramOffset);
+    subdivide(halves.second, mid, t1, depth + 1, tolerance16Sq, points, params, paramOffset);
+}
+
+} // namespace
+
+void flattenAdaptive(const CubicBezier& bez, float tolerance,
+                     std::vector<Vector3D>& points, std::vector<float>& params,
+                     float paramOffset) {
+    tolerance = std::max(tolerance, 1e-3f);
+    subdivide(bez, 0.0f, 1.0f, 0, 16.0f * tolerance * tolerance, points, params, paramOffset);
+}
+
+} // namespace GameFusion
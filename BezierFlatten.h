@@ -0,0 +1,35 @@
+#ifndef BEZIERFLATTEN_H
+#define BEZIERFLATTEN_H
+
+#include <vector>
+#include <cstddef>
+#include "BezierCurve.h"
+
+namespace GameFusion {
+
+enum class FlattenKernel {
+    Scalar,     // Horner evaluation, any CPU
+    SSE2,       // 4 parameter values per instruction
+    AVX2        // 8 parameter values per instruction
+};
+
+// Kernel picked for this CPU, detected once on first use
+FlattenKernel flattenKernel();
+
+// Append stepCount + 1 uniformly spaced samples (t = i / stepCount) of each
+// segment to out, one segment after the other. This is the vertex layout of
+// BezierCurve::assess. The SIMD kernels evaluate the lanes by forward
+// differencing; segment end points are written exactly.
+void flattenCubics(const CubicBezier* segments, size_t count, int stepCount, FlattenBuffer& out);
+
+// Append the end points of an adaptive polyline through bez, subdivided until
+// each piece deviates less than tolerance from its chord. The start point is
+// not appended (it is the previous segment's end). params receives
+// paramOffset + local t of every appended point.
+void flattenAdaptive(const CubicBezier& bez, float tolerance,
+                     std::vector<Vector3D>& points, std::vector<float>& params,
+                     float paramOffset = 0.0f);
+
+} // namespace GameFusion
+
+#endif // BEZIERFLATTEN_H
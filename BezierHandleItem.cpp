@@ -0,0 +1,240 @@
+#include "BezierHandleItem.h"
+
+#include <QPainter>
+#include <QPen>
+#include <QStyleOptionGraphicsItem>
+#include <QVector>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Marker radius on screen, in device pixels
+const qreal kMarkerRadius = 3.0;
+const qreal kHighlightRadius = 5.0;
+
+// Markers are sized on screen, so they overhang the handle bounds by
+// kMarkerRadius / zoom; this covers them down to 1/20 zoom
+const qreal kBoundsPad = 64.0;
+
+// Below this zoom only the anchors are drawn, as dots
+const qreal kTangentLod = 0.2;
+
+// Handles spanning more cells go to the oversized list instead of the grid
+const qint64 kMaxCellsPerHandle = 256;
+
+} // namespace
+
+BezierHandleItem::BezierHandleItem(QGraphicsItem* parent)
+    : QGraphicsItem(parent) {
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption, true);  // exposedRect for culling
+}
+
+int BezierHandleItem::cellIndex(qreal v) const {
+    return static_cast<int>(std::floor(v / m_cellSize));
+}
+
+void BezierHandleItem::clear() {
+    prepareGeometryChange();
+    m_handles.clear();
+    m_cells.clear();
+    m_oversized.clear();
+    m_visited.clear();
+    m_bounds = QRectF();
+    m_highlight = Hit();
+}
+
+void BezierHandleItem::setCurves(const std::vector<GameFusion::BezierCurve>& curves) {
+    clear();
+
+    size_t total = 0;
+    for (const GameFusion::BezierCurve& curve : curves)
+        total += curve.size();
+    m_handles.reserve(total);
+
+    for (size_t s = 0; s < curves.size(); ++s) {
+        const GameFusion::BezierCurve& curve = curves[s];
+        for (size_t i = 0; i < curve.size(); ++i) {
+            const GameFusion::BezierControl& control = curve[i];
+            Handle handle;
+            handle.point = QPointF(control.point.x(), control.point.y());
+            handle.left = handle.point + QPointF(control.leftControl.x(), control.leftControl.y());
+            handle.right = handle.point + QPointF(control.rightControl.x(), control.rightControl.y());
+            handle.bounds = QRectF(handle.left, handle.right).normalized().united(QRectF(handle.point, QSizeF(0, 0)));
+            handle.stroke = static_cast<int>(s);
+            handle.index = static_cast<int>(i);
+            m_bounds = m_handles.empty() ? handle.bounds : m_bounds.united(handle.bounds);
+            m_handles.push_back(handle);
+        }
+    }
+
+    for (int id = 0; id < static_cast<int>(m_handles.size()); ++id) {
+        const QRectF& b = m_handles[id].bounds;
+        const int x0 = cellIndex(b.left()), x1 = cellIndex(b.right());
+        const int y0 = cellIndex(b.top()), y1 = cellIndex(b.bottom());
+        if (qint64(x1 - x0 + 1) * (y1 - y0 + 1) > kMaxCellsPerHandle) {
+            m_oversized.push_back(id);
+            continue;
+        }
+        for (int cy = y0; cy <= y1; ++cy)
+            for (int cx = x0; cx <= x1; ++cx)
+                m_cells[cellKey(cx, cy)].push_back(id);
+    }
+    m_visited.assign(m_handles.size(), 0);
+    update();
+}
+
+template <typename Fn>
+void BezierHandleItem::forEachHandle(const QRectF& rect, Fn fn) const {
+    if (m_handles.empty() || !rect.intersects(m_bounds.adjusted(-1, -1, 1, 1)))
+        return;
+
+    if (++m_queryStamp == 0) {
+        std::fill(m_visited.begin(), m_visited.end(), 0);
+        m_queryStamp = 1;
+    }
+
+    auto visit = [&](int id) {
+        if (m_visited[id] == m_queryStamp)
+            return;
+        m_visited[id] = m_queryStamp;
+        if (m_handles[id].bounds.intersects(rect) || rect.contains(m_handles[id].point))
+            fn(m_handles[id]);
+    };
+
+    // Clamp to the populated area so a zoomed out exposed rect does not walk
+    // empty cells
+    const QRectF area = rect.intersected(m_bounds.adjusted(-1, -1, 1, 1));
+    const int x0 = cellIndex(area.left()), x1 = cellIndex(area.right());
+    const int y0 = cellIndex(area.top()), y1 = cellIndex(area.bottom());
+    if (qint64(x1 - x0 + 1) * (y1 - y0 + 1) > m_cells.size()) {
+        for (auto it = m_cells.cbegin(); it != m_cells.cend(); ++it) {
+            const int cx = static_cast<int>(quint32(it.key() >> 32));
+            const int cy = static_cast<int>(quint32(it.key()));
+            if (cx < x0 || cx > x1 || cy < y0 || cy > y1)
+                continue;
+            for (int id : it.value())
+                visit(id);
+        }
+    } else {
+        for (int cy = y0; cy <= y1; ++cy) {
+            for (int cx = x0; cx <= x1; ++cx) {
+                auto it = m_cells.constFind(cellKey(cx, cy));
+                if (it == m_cells.cend())
+                    continue;
+                for (int id : it.value())
+                    visit(id);
+            }
+        }
+    }
+    for (int id : m_oversized)
+        visit(id);
+}
+
+QRectF BezierHandleItem::handleRect(const Handle& handle, Part part, qreal radius) const {
+    QPointF center = handle.point;
+    if (part == Part::LeftControl)
+        center = handle.left;
+    else if (part == Part::RightControl)
+        center = handle.right;
+    return QRectF(center.x() - radius, center.y() - radius, 2 * radius, 2 * radius);
+}
+
+BezierHandleItem::Hit BezierHandleItem::hitTest(const QPointF& pos, qreal radius) const {
+    Hit best;
+    qreal bestDistance = radius * radius;
+
+    auto consider = [&](const Handle& handle, const QPointF& center, Part part) {
+        const qreal dx = center.x() - pos.x();
+        const qreal dy = center.y() - pos.y();
+        const qreal d = dx * dx + dy * dy;
+        if (d <= bestDistance) {
+            bestDistance = d;
+            best.stroke = handle.stroke;
+            best.handle = handle.index;
+            best.part = part;
+        }
+    };
+
+    const QRectF area(pos.x() - radius, pos.y() - radius, 2 * radius, 2 * radius);
+    forEachHandle(area, [&](const Handle& handle) {
+        // Controls first, so an anchor wins a tie with its collapsed tangent
+        consider(handle, handle.left, Part::LeftControl);
+        consider(handle, handle.right, Part::RightControl);
+        consider(handle, handle.point, Part::Point);
+    });
+    return best;
+}
+
+void BezierHandleItem::setHighlight(const Hit& hit) {
+    if (hit == m_highlight)
+        return;
+    m_highlight = hit;
+    update();
+}
+
+QRectF BezierHandleItem::boundingRect() const {
+    if (m_handles.empty())
+        return QRectF();
+    return m_bounds.adjusted(-kBoundsPad, -kBoundsPad, kBoundsPad, kBoundsPad);
+}
+
+void BezierHandleItem::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget) {
+    Q_UNUSED(widget);
+    if (m_handles.empty())
+        return;
+
+    const qreal lod = QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform());
+    const qreal radius = kMarkerRadius / std::max(lod, 1e-6);
+    // Marker overhang around the exposed area
+    const QRectF exposed = option->exposedRect.adjusted(-radius, -radius, radius, radius);
+
+    QPen outline(Qt::black, 1);
+    outline.setCosmetic(true);
+
+    if (lod < kTangentLod) {
+        // Too dense for markers: one dot per anchor
+        QPolygonF anchors;
+        forEachHandle(exposed, [&](const Handle& handle) { anchors.append(handle.point); });
+        QPen dot(Qt::red, 2);
+        dot.setCosmetic(true);
+        painter->setPen(dot);
+        painter->drawPoints(anchors);
+        return;
+    }
+
+    QVector<QLineF> tangents;
+    QVector<const Handle*> visible;
+    forEachHandle(exposed, [&](const Handle& handle) {
+        tangents.append(QLineF(handle.point, handle.left));
+        tangents.append(QLineF(handle.point, handle.right));
+        visible.append(&handle);
+    });
+
+    painter->setRenderHint(QPainter::Antialiasing, true);
+    QPen tangentPen(Qt::blue, 1);
+    tangentPen.setCosmetic(true);
+    painter->setPen(tangentPen);
+    painter->drawLines(tangents);
+
+    painter->setPen(outline);
+    painter->setBrush(Qt::green);
+    for (const Handle* handle : visible) {
+        painter->drawEllipse(handleRect(*handle, Part::LeftControl, radius));
+        painter->drawEllipse(handleRect(*handle, Part::RightControl, radius));
+    }
+    painter->setBrush(Qt::red);
+    for (const Handle* handle : visible)
+        painter->drawEllipse(handleRect(*handle, Part::Point, radius));
+
+    if (m_highlight.isValid()) {
+        // Highlighted handle is found by its stroke / index among the visible ones
+        for (const Handle* handle : visible) {
+            if (handle->stroke != m_highlight.stroke || handle->index != m_highlight.handle)
+                continue;
+            painter->setBrush(Qt::yellow);
+            painter->drawEllipse(handleRect(*handle, m_highlight.part, kHighlightRadius / std::max(lod, 1e-6)));
+            break;
+        }
+    }
+}
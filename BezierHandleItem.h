@@ -0,0 +1,83 @@
+#ifndef BEZIERHANDLEITEM_H
+#define BEZIERHANDLEITEM_H
+
+#include <QGraphicsItem>
+#include <QHash>
+#include <QPointF>
+#include <QRectF>
+#include <vector>
+#include "BezierCurve.h"
+
+// Edit mode overlay: the anchors and tangents of every stroke of a layer drawn
+// by one scene item.
+//
+// setCurves() copies the handle positions into a flat array bucketed on a
+// uniform grid; paint() walks only the buckets under the exposed rect, and
+// hit-testing measures the distance to the handful of handles near the cursor.
+// Markers keep a constant size on screen whatever the zoom.
+class BezierHandleItem : public QGraphicsItem {
+public:
+    enum class Part {
+        None,
+        Point,
+        LeftControl,
+        RightControl
+    };
+
+    struct Hit {
+        int stroke = -1;
+        int handle = -1;
+        Part part = Part::None;
+        bool isValid() const { return stroke >= 0; }
+        bool operator==(const Hit& other) const {
+            return stroke == other.stroke && handle == other.handle && part == other.part;
+        }
+    };
+
+    explicit BezierHandleItem(QGraphicsItem* parent = nullptr);
+
+    void setCurves(const std::vector<GameFusion::BezierCurve>& curves);
+    void clear();
+
+    int handleCount() const { return static_cast<int>(m_handles.size()); }
+
+    // Closest anchor or control point within radius of pos (item coordinates)
+    Hit hitTest(const QPointF& pos, qreal radius) const;
+
+    // Handle drawn enlarged, e.g. the one under the cursor
+    void setHighlight(const Hit& hit);
+
+    QRectF boundingRect() const override;
+    void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget) override;
+
+private:
+    struct Handle {
+        QPointF point;
+        QPointF left;       // absolute, not relative to point
+        QPointF right;
+        QRectF bounds;
+        int stroke = 0;
+        int index = 0;
+    };
+
+    static quint64 cellKey(int cx, int cy) {
+        return (quint64(quint32(cx)) << 32) | quint32(cy);
+    }
+    int cellIndex(qreal v) const;
+    QRectF handleRect(const Handle& handle, Part part, qreal radius) const;
+
+    // Visit every handle whose bounds overlap rect once
+    template <typename Fn> void forEachHandle(const QRectF& rect, Fn fn) const;
+
+    qreal m_cellSize = 128.0;
+    std::vector<Handle> m_handles;
+    QHash<quint64, std::vector<int>> m_cells;
+    std::vector<int> m_oversized;       // tangents too long to bucket
+    QRectF m_bounds;
+    Hit m_highlight;
+
+    mutable std::vector<unsigned> m_visited;
+    mutable unsigned m_queryStamp = 0;
+};
+
+#endif // BEZIERHANDLEITEM_H
@@ -0,0 +1,340 @@
+#include "CurveIntersector.h"
+
+#include <algorithm>
+#include <cmath>
+#include "StrokeSpatialIndex.h"
+
+namespace GameFusion {
+
+namespace {
+
+// Sub-curves smaller than this (px) on both sides are a crossing
+const double kPointTolerance = 1e-4;
+
+// Clipping steps allowed per segment pair. Transversal crossings take a few
+// dozen; coincident curves never narrow down and run out instead.
+const int kMaxClipSteps = 2048;
+
+// A clip keeping more than this fraction of a range splits it in halves
+const double kMaxClipKeep = 0.8;
+
+// Crossings closer than this in both parameters are the same one, found
+// twice where segments join
+const float kMergeParam = 1e-4f;
+
+// Cubic in double precision; clipping narrows far below float resolution
+struct Cubic {
+    double x[4], y[4];
+};
+
+Cubic toCubic(const CubicBezier& bez) {
+    const Vector3D* p[4] = {&bez.p0, &bez.p1, &bez.p2, &bez.p3};
+    Cubic c;
+    for (int i = 0; i < 4; ++i) {
+        c.x[i] = p[i]->x();
+        c.y[i] = p[i]->y();
+    }
+    return c;
+}
+
+// de Casteljau split at t
+void split(const Cubic& c, double t, Cubic* left, Cubic* right) {
+    double x[4][4], y[4][4];
+    for (int i = 0; i < 4; ++i) {
+        x[0][i] = c.x[i];
+        y[0][i] = c.y[i];
+    }
+    for (int level = 1; level < 4; ++level) {
+        for (int i = 0; i < 4 - level; ++i) {
+            x[level][i] = x[level - 1][i] + (x[level - 1][i + 1] - x[level - 1][i]) * t;
+            y[level][i] = y[level - 1][i] + (y[level - 1][i + 1] - y[level - 1][i]) * t;
+        }
+    }
+    for (int i = 0; i < 4; ++i) {
+        if (left) {
+            left->x[i] = x[i][0];
+            left->y[i] = y[i][0];
+        }
+        if (right) {
+            right->x[i] = x[3 - i][i];
+            right->y[i] = y[3 - i][i];
+        }
+    }
+}
+
+// The part of c between t0 and t1
+Cubic subCubic(const Cubic& c, double t0, double t1) {
+    Cubic right = c, out;
+    if (t0 > 0.0)
+        split(c, t0, nullptr, &right);
+    if (t1 >= 1.0)
+        return right;
+    split(right, (t1 - t0) / (1.0 - t0), &out, nullptr);
+    return out;
+}
+
+struct Box {
+    double minX, minY, maxX, maxY;
+
+    double extent() const { return std::max(maxX - minX, maxY - minY); }
+    bool overlaps(const Box& o) const {
+        return !(maxX < o.minX || o.maxX < minX || maxY < o.minY || o.maxY < minY);
+    }
+};
+
+// Box of the control polygon, which holds the curve
+Box hullBox(const Cubic& c) {
+    Box box{c.x[0], c.y[0], c.x[0], c.y[0]};
+    for (int i = 1; i < 4; ++i) {
+        box.minX = std::min(box.minX, c.x[i]);
+        box.maxX = std::max(box.maxX, c.x[i]);
+        box.minY = std::min(box.minY, c.y[i]);
+        box.maxY = std::max(box.maxY, c.y[i]);
+    }
+    return box;
+}
+
+// Range [lo, hi] of c's parameter outside of which c stays clear of the fat
+// line of other: the band around other's chord that holds all of other.
+// Returns false when c misses the band entirely. A degenerate other (all its
+// points together) has no line and does not clip.
+bool clipToFatLine(const Cubic& c, const Cubic& other, double& lo, double& hi) {
+    lo = 0.0;
+    hi = 1.0;
+
+    // Chord direction, or the first distinct control point for closed loops
+    double dx = 0.0, dy = 0.0;
+    for (int i = 3; i > 0 && dx == 0.0 && dy == 0.0; --i) {
+        dx = other.x[i] - other.x[0];
+        dy = other.y[i] - other.y[0];
+    }
+    const double length = std::hypot(dx, dy);
+    if (length == 0.0)
+        return true;
+
+    const double nx = -dy / length, ny = dx / length;
+    const double offset = -(nx * other.x[0] + ny * other.y[0]);
+    auto distance = [&](double x, double y) { return nx * x + ny * y + offset; };
+
+    const double d1 = distance(other.x[1], other.y[1]);
+    const double d2 = distance(other.x[2], other.y[2]);
+    const double factor = d1 * d2 > 0.0 ? 3.0 / 4.0 : 4.0 / 9.0;
+    const double slack = kPointTolerance * 0.5;
+    const double dMin = factor * std::min({0.0, d1, d2}) - slack;
+    const double dMax = factor * std::max({0.0, d1, d2}) + slack;
+
+    // c's distance to the line is a cubic with control points (i / 3, e[i]);
+    // the range is where their convex hull lies within [dMin, dMax]. Every
+    // hull edge is one of the six point pairs, so testing all pairs suffices.
+    double e[4];
+    for (int i = 0; i < 4; ++i)
+        e[i] = distance(c.x[i], c.y[i]);
+
+    double rangeLo = 2.0, rangeHi = -1.0;
+    auto include = [&](double t) {
+        rangeLo = std::min(rangeLo, t);
+        rangeHi = std::max(rangeHi, t);
+    };
+    for (int i = 0; i < 4; ++i) {
+        if (e[i] >= dMin && e[i] <= dMax)
+            include(i / 3.0);
+        for (int j = i + 1; j < 4; ++j) {
+            for (double bound : {dMin, dMax}) {
+                if ((e[i] - bound) * (e[j] - bound) < 0.0)
+                    include((i + (j - i) * (bound - e[i]) / (e[j] - e[i])) / 3.0);
+            }
+        }
+    }
+    if (rangeLo > rangeHi)
+        return false;
+    lo = std::clamp(rangeLo, 0.0, 1.0);
+    hi = std::clamp(rangeHi, 0.0, 1.0);
+    return true;
+}
+
+} // namespace
+
+void CurveSegmentTree::build(const BezierCurve& curve) {
+    m_segments.clear();
+    m_boxes.clear();
+    m_nodes.clear();
+
+    const int count = curve.segmentCount();
+    m_segments.reserve(count);
+    m_boxes.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        m_segments.push_back(curve.segment(i));
+        m_boxes.push_back(getBBox(m_segments.back()));
+    }
+    if (count > 0) {
+        m_nodes.reserve(2 * count - 1);
+        buildNode(0, count);
+    }
+}
+
+int CurveSegmentTree::buildNode(int first, int count) {
+    const int index = static_cast<int>(m_nodes.size());
+    m_nodes.emplace_back();
+    m_nodes[index].first = first;
+    m_nodes[index].count = count;
+
+    if (count == 1) {
+        m_nodes[index].box = m_boxes[first];
+        return index;
+    }
+
+    const int half = count / 2;
+    const int left = buildNode(first, half);
+    const int right = buildNode(first + half, count - half);
+    // m_nodes may have grown; index again
+    Node& node = m_nodes[index];
+    node.left = left;
+    node.right = right;
+    const BBox& a = m_nodes[left].box;
+    const BBox& b = m_nodes[right].box;
+    node.box.minX = std::min(a.minX, b.minX);
+    node.box.minY = std::min(a.minY, b.minY);
+    node.box.maxX = std::max(a.maxX, b.maxX);
+    node.box.maxY = std::max(a.maxY, b.maxY);
+    return index;
+}
+
+CurveIntersector::CurveIntersector(const BezierCurve& cutter)
+    : m_cutter(cutter) {
+}
+
+void CurveIntersector::intersectSegments(const CubicBezier& a, const CubicBezier& b,
+                                         std::vector<std::pair<float, float>>& params) {
+    const Cubic ca = toCubic(a), cb = toCubic(b);
+    const Box boundsA = hullBox(ca), boundsB = hullBox(cb);
+    // Dots (single handle strokes) have nothing to cross
+    if (!boundsA.overlaps(boundsB) || boundsA.extent() == 0.0 || boundsB.extent() == 0.0)
+        return;
+
+    struct Range {
+        double a0, a1, b0, b1;
+    };
+    std::vector<Range> stack{{0.0, 1.0, 0.0, 1.0}};
+    std::vector<std::pair<double, double>> found;
+
+    int steps = 0;
+    while (!stack.empty()) {
+        if (++steps > kMaxClipSteps)
+            return;  // coincident stretch
+        Range r = stack.back();
+        stack.pop_back();
+
+        Cubic sa = subCubic(ca, r.a0, r.a1);
+        Cubic sb = subCubic(cb, r.b0, r.b1);
+        const Box boxA = hullBox(sa), boxB = hullBox(sb);
+        if (!boxA.overlaps(boxB))
+            continue;
+        if (boxA.extent() < kPointTolerance && boxB.extent() < kPointTolerance) {
+            found.emplace_back((r.a0 + r.a1) * 0.5, (r.b0 + r.b1) * 0.5);
+            continue;
+        }
+
+        // Clip a to b's fat line, then b to the clipped a's
+        double lo, hi;
+        if (!clipToFatLine(sa, sb, lo, hi))
+            continue;
+        const double widthA = r.a1 - r.a0;
+        const double keepA = hi - lo;
+        r.a1 = r.a0 + widthA * hi;
+        r.a0 = r.a0 + widthA * lo;
+        if (keepA < 1.0)
+            sa = subCubic(ca, r.a0, r.a1);
+
+        if (!clipToFatLine(sb, sa, lo, hi))
+            continue;
+        const double widthB = r.b1 - r.b0;
+        const double keepB = hi - lo;
+        r.b1 = r.b0 + widthB * hi;
+        r.b0 = r.b0 + widthB * lo;
+
+        if (keepA > kMaxClipKeep && keepB > kMaxClipKeep) {
+            // Several crossings or a tangency: split the longer curve
+            if (boxA.extent() >= boxB.extent()) {
+                const double mid = (r.a0 + r.a1) * 0.5;
+                stack.push_back({r.a0, mid, r.b0, r.b1});
+                stack.push_back({mid, r.a1, r.b0, r.b1});
+            } else {
+                const double mid = (r.b0 + r.b1) * 0.5;
+                stack.push_back({r.a0, r.a1, r.b0, mid});
+                stack.push_back({r.a0, r.a1, mid, r.b1});
+            }
+        } else {
+            stack.push_back(r);
+        }
+    }
+
+    std::sort(found.begin(), found.end());
+    size_t first = params.size();
+    for (const auto& [ta, tb] : found) {
+        if (params.size() > first &&
+            std::abs(float(ta) - params.back().first) < kMergeParam &&
+            std::abs(float(tb) - params.back().second) < kMergeParam)
+            continue;
+        params.emplace_back(float(ta), float(tb));
+    }
+}
+
+void CurveIntersector::collect(const CubicBezier& segment, int stroke, int index, int cutterIndex,
+                               std::vector<std::pair<float, float>>& params,
+                               std::vector<CurveCrossing>& out) const {
+    params.clear();
+    intersectSegments(segment, m_cutter.segment(cutterIndex), params);
+    for (const auto& [t, s] : params) {
+        CurveCrossing crossing;
+        crossing.stroke = stroke;
+        crossing.segment = index;
+        crossing.t = t;
+        crossing.cutterSegment = cutterIndex;
+        crossing.cutterT = s;
+        crossing.point = segment.evaluate(t);
+        out.push_back(crossing);
+    }
+}
+
+// Sorted by stroke and parameter, with crossings found on both sides of a
+// segment joint merged
+static void sortAndMerge(std::vector<CurveCrossing>& crossings) {
+    std::sort(crossings.begin(), crossings.end(), [](const CurveCrossing& a, const CurveCrossing& b) {
+        if (a.stroke != b.stroke)
+            return a.stroke < b.stroke;
+        return a.param() < b.param();
+    });
+    auto same = [](const CurveCrossing& a, const CurveCrossing& b) {
+        return a.stroke == b.stroke &&
+               std::abs(a.param() - b.param()) < kMergeParam &&
+               std::abs(a.cutterParam() - b.cutterParam()) < kMergeParam;
+    };
+    crossings.erase(std::unique(crossings.begin(), crossings.end(), same), crossings.end());
+}
+
+std::vector<CurveCrossing> CurveIntersector::intersect(const BezierCurve& curve) const {
+    return intersect(CurveSegmentTree(curve));
+}
+
+std::vector<CurveCrossing> CurveIntersector::intersect(const CurveSegmentTree& curve) const {
+    std::vector<CurveCrossing> crossings;
+    std::vector<std::pair<float, float>> params;
+    curve.forEachOverlap(m_cutter, [&](int index, int cutterIndex) {
+        collect(curve.segment(index), -1, index, cutterIndex, params, crossings);
+    });
+    sortAndMerge(crossings);
+    return crossings;
+}
+
+std::vector<CurveCrossing> CurveIntersector::intersect(const StrokeSpatialIndex& index) const {
+    std::vector<CurveCrossing> crossings;
+    std::vector<std::pair<float, float>> params;
+    for (int cutterIndex = 0; cutterIndex < m_cutter.segmentCount(); ++cutterIndex) {
+        for (const auto& [stroke, segment] : index.querySegments(m_cutter.segmentBox(cutterIndex)))
+            collect(index.segment(stroke, segment), stroke, segment, cutterIndex, params, crossings);
+    }
+    sortAndMerge(crossings);
+    return crossings;
+}
+
+} // namespace GameFusion
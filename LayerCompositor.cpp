@@ -0,0 +1,312 @@
+#include "LayerCompositor.h"
+
+#include <QtConcurrent>
+#include <algorithm>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LAYERCOMPOSITOR_SSE2
+#endif
+
+using GameFusion::BlendMode;
+
+namespace {
+
+// Rows per parallel task: a 4K band of 32 rows is about 0.5 MB per layer
+const int kBandHeight = 32;
+
+// a * b / 255, correctly rounded, for 0..255 inputs
+inline int mul255(int a, int b) {
+    const int t = a * b + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+// One premultiplied channel of source s over destination d. Alpha goes
+// through the same formula and comes out as sa + da - sa * da in every mode.
+template <BlendMode Mode>
+inline int blendChannel(int s, int d, int sa, int da) {
+    switch (Mode) {
+    case BlendMode::Multiply:
+        return mul255(s, d) + mul255(s, 255 - da) + mul255(d, 255 - sa);
+    case BlendMode::Screen:
+        return s + d - mul255(s, d);
+    case BlendMode::Overlay: {
+        // Multiply where the destination is dark, screen where it is light
+        const int base = 2 * d < da ? 2 * mul255(s, d)
+                                    : mul255(sa, da) - 2 * mul255(da - d, sa - s);
+        return base + mul255(s, 255 - da) + mul255(d, 255 - sa);
+    }
+    case BlendMode::Opacity:
+    default:
+        return s + mul255(d, 255 - sa);
+    }
+}
+
+template <BlendMode Mode>
+inline quint32 blendPixel(quint32 d, quint32 s, int opacity) {
+    if (opacity != 255) {
+        quint32 faded = 0;
+        for (int shift = 0; shift < 32; shift += 8)
+            faded |= quint32(mul255((s >> shift) & 0xff, opacity)) << shift;
+        s = faded;
+    }
+    if (!s)
+        return d;
+
+    const int sa = s >> 24;
+    const int da = d >> 24;
+    quint32 out = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        const int c = blendChannel<Mode>((s >> shift) & 0xff, (d >> shift) & 0xff, sa, da);
+        out |= quint32(std::clamp(c, 0, 255)) << shift;
+    }
+    return out;
+}
+
+#ifdef LAYERCOMPOSITOR_SSE2
+
+// Same math on eight 16 bit channels (two pixels) at a time
+inline __m128i mul255x8(__m128i a, __m128i b) {
+    const __m128i t = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+inline __m128i alphax8(__m128i v) {
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+template <BlendMode Mode>
+inline __m128i blendx8(__m128i s, __m128i d) {
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i sa = alphax8(s);
+    const __m128i da = alphax8(d);
+    switch (Mode) {
+    case BlendMode::Multiply:
+        return _mm_add_epi16(_mm_add_epi16(mul255x8(s, d), mul255x8(s, _mm_sub_epi16(full, da))),
+                             mul255x8(d, _mm_sub_epi16(full, sa)));
+    case BlendMode::Screen:
+        return _mm_sub_epi16(_mm_add_epi16(s, d), mul255x8(s, d));
+    case BlendMode::Overlay: {
+        const __m128i dark = _mm_cmplt_epi16(_mm_add_epi16(d, d), da);
+        const __m128i multiply = _mm_slli_epi16(mul255x8(s, d), 1);
+        const __m128i screen = _mm_sub_epi16(mul255x8(sa, da),
+                                             _mm_slli_epi16(mul255x8(_mm_sub_epi16(da, d), _mm_sub_epi16(sa, s)), 1));
+        const __m128i base = _mm_or_si128(_mm_and_si128(dark, multiply), _mm_andnot_si128(dark, screen));
+        return _mm_add_epi16(_mm_add_epi16(base, mul255x8(s, _mm_sub_epi16(full, da))),
+                             mul255x8(d, _mm_sub_epi16(full, sa)));
+    }
+    case BlendMode::Opacity:
+    default:
+        return _mm_add_epi16(s, mul255x8(d, _mm_sub_epi16(full, sa)));
+    }
+}
+
+#endif
+
+template <BlendMode Mode>
+void blendSpan(quint32* dst, const quint32* src, int count, int opacity) {
+    int i = 0;
+#ifdef LAYERCOMPOSITOR_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi16(short(opacity));
+    for (; i + 4 <= count; i += 4) {
+        const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(s, zero)) == 0xffff)
+            continue;
+        if (Mode == BlendMode::Opacity && opacity == 255 &&
+            _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_srli_epi32(s, 24), _mm_set1_epi32(255))) == 0xffff) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), s);  // opaque source replaces dst
+            continue;
+        }
+        const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+
+        __m128i sLo = _mm_unpacklo_epi8(s, zero);
+        __m128i sHi = _mm_unpackhi_epi8(s, zero);
+        if (opacity != 255) {
+            sLo = mul255x8(sLo, alpha);
+            sHi = mul255x8(sHi, alpha);
+        }
+        // Saturating pack clamps to 0..255 like the scalar path
+        const __m128i lo = blendx8<Mode>(sLo, _mm_unpacklo_epi8(d, zero));
+        const __m128i hi = blendx8<Mode>(sHi, _mm_unpackhi_epi8(d, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; i < count; ++i) {
+        if (src[i])
+            dst[i] = blendPixel<Mode>(dst[i], src[i], opacity);
+    }
+}
+
+// Add count source pixels to 16 bit per channel sums
+void accumulateSpan(quint16* sums, const quint32* src, int count) {
+    int i = 0;
+#ifdef LAYERCOMPOSITOR_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4) {
+        // No zero skip here: adding is as cheap as the test, and the branch
+        // mispredicts on partly covered spans
+        const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i* sum = reinterpret_cast<__m128i*>(sums + 4 * i);
+        _mm_storeu_si128(sum, _mm_add_epi16(_mm_loadu_si128(sum), _mm_unpacklo_epi8(s, zero)));
+        _mm_storeu_si128(sum + 1, _mm_add_epi16(_mm_loadu_si128(sum + 1), _mm_unpackhi_epi8(s, zero)));
+    }
+#endif
+    for (; i < count; ++i) {
+        const quint32 s = src[i];
+        if (!s)
+            continue;
+        for (int c = 0; c < 4; ++c)
+            sums[4 * i + c] += (s >> (8 * c)) & 0xff;
+    }
+}
+
+// sums / n, rounded, through a 16 bit reciprocal: ((sum + n / 2) * reciprocal) >> 16
+void resolveSpan(quint32* dst, const quint16* sums, int count, quint16 half, quint16 reciprocal) {
+    int i = 0;
+#ifdef LAYERCOMPOSITOR_SSE2
+    const __m128i h = _mm_set1_epi16(short(half));
+    const __m128i r = _mm_set1_epi16(short(reciprocal));
+    for (; i + 4 <= count; i += 4) {
+        const __m128i* sum = reinterpret_cast<const __m128i*>(sums + 4 * i);
+        const __m128i lo = _mm_mulhi_epu16(_mm_add_epi16(_mm_loadu_si128(sum), h), r);
+        const __m128i hi = _mm_mulhi_epu16(_mm_add_epi16(_mm_loadu_si128(sum + 1), h), r);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; i < count; ++i) {
+        quint32 out = 0;
+        for (int c = 0; c < 4; ++c)
+            out |= quint32(((sums[4 * i + c] + half) * quint32(reciprocal)) >> 16) << (8 * c);
+        dst[i] = out;
+    }
+}
+
+struct Pass {
+    QImage image;
+    QRect rect;         // target area covered, clipped
+    QPoint offset;
+    BlendMode mode;
+    int opacity;
+};
+
+} // namespace
+
+void LayerCompositor::blendRow(quint32* dst, const quint32* src, int count, BlendMode mode, int opacity) {
+    switch (mode) {
+    case BlendMode::Multiply: blendSpan<BlendMode::Multiply>(dst, src, count, opacity); break;
+    case BlendMode::Screen:   blendSpan<BlendMode::Screen>(dst, src, count, opacity); break;
+    case BlendMode::Overlay:  blendSpan<BlendMode::Overlay>(dst, src, count, opacity); break;
+    case BlendMode::Opacity:
+    default:                  blendSpan<BlendMode::Opacity>(dst, src, count, opacity); break;
+    }
+}
+
+void LayerCompositor::composite(QImage& target, const QVector<Layer>& layers) {
+    if (target.isNull())
+        return;
+    Q_ASSERT(target.format() == QImage::Format_ARGB32_Premultiplied);
+
+    QVector<Pass> passes;
+    passes.reserve(layers.size());
+    for (const Layer& layer : layers) {
+        const int opacity = std::clamp(int(layer.opacity * 255.0f + 0.5f), 0, 255);
+        const QRect rect = QRect(layer.offset, layer.image.size()).intersected(target.rect());
+        if (opacity == 0 || rect.isEmpty())
+            continue;
+        QImage image = layer.image.format() == QImage::Format_ARGB32_Premultiplied
+                           ? layer.image
+                           : layer.image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        passes.append({image, rect, layer.offset, layer.mode, opacity});
+    }
+    if (passes.isEmpty())
+        return;
+
+    // Detach once here rather than from the worker threads
+    uchar* bits = target.bits();
+    const qsizetype bytesPerLine = target.bytesPerLine();
+    const int height = target.height();
+
+    // Each band goes through every layer row by row, so the destination row
+    // stays in cache across layers
+    QVector<int> bands;
+    for (int y = 0; y < height; y += kBandHeight)
+        bands.append(y);
+
+    QtConcurrent::blockingMap(bands, [&](int y0) {
+        const int y1 = std::min(y0 + kBandHeight, height);
+        // A layer given as its tiles is hundreds of small passes; only those
+        // crossing the band are looked at per row
+        std::vector<const Pass*> bandPasses;
+        for (const Pass& pass : passes) {
+            if (pass.rect.top() < y1 && pass.rect.bottom() >= y0)
+                bandPasses.push_back(&pass);
+        }
+        for (int y = y0; y < y1; ++y) {
+            quint32* dst = reinterpret_cast<quint32*>(bits + y * bytesPerLine);
+            for (const Pass* pass : bandPasses) {
+                if (y < pass->rect.top() || y > pass->rect.bottom())
+                    continue;
+                const quint32* src = reinterpret_cast<const quint32*>(pass->image.constScanLine(y - pass->offset.y()));
+                const int x = pass->rect.left();
+                blendRow(dst + x, src + (x - pass->offset.x()), pass->rect.width(), pass->mode, pass->opacity);
+            }
+        }
+    });
+}
+
+void LayerCompositor::accumulate(QImage& target, const QImage& source, const QVector<QPoint>& offsets) {
+    if (target.isNull())
+        return;
+    Q_ASSERT(target.format() == QImage::Format_ARGB32_Premultiplied);
+    Q_ASSERT(offsets.size() <= kMaxAccumulateSamples);
+    target.fill(Qt::transparent);
+    const int count = std::min<int>(offsets.size(), kMaxAccumulateSamples);
+    if (count == 0 || source.isNull())
+        return;
+
+    const QImage src = source.format() == QImage::Format_ARGB32_Premultiplied
+                           ? source
+                           : source.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    // Rounded up, so the largest average still comes out as 255; one copy
+    // does not fit in 16 bits and is a plain shifted copy
+    const quint16 reciprocal = count > 1 ? quint16((65536 + count - 1) / count) : 0;
+    const quint16 half = quint16(count / 2);
+
+    uchar* bits = target.bits();
+    const qsizetype bytesPerLine = target.bytesPerLine();
+    const int width = target.width();
+    const int height = target.height();
+
+    QVector<int> bands;
+    for (int y = 0; y < height; y += kBandHeight)
+        bands.append(y);
+
+    QtConcurrent::blockingMap(bands, [&](int y0) {
+        const int y1 = std::min(y0 + kBandHeight, height);
+        std::vector<quint16> sums(size_t(width) * 4);
+        for (int y = y0; y < y1; ++y) {
+            quint32* dst = reinterpret_cast<quint32*>(bits + y * bytesPerLine);
+            if (count > 1)
+                std::fill(sums.begin(), sums.end(), quint16(0));
+            for (int k = 0; k < count; ++k) {
+                const QPoint& offset = offsets[k];
+                const int sy = y - offset.y();
+                if (sy < 0 || sy >= src.height())
+                    continue;
+                const int x0 = std::max(0, offset.x());
+                const int x1 = std::min(width, src.width() + offset.x());
+                if (x0 >= x1)
+                    continue;
+                const quint32* row = reinterpret_cast<const quint32*>(src.constScanLine(sy)) + (x0 - offset.x());
+                if (count == 1)
+                    std::copy(row, row + (x1 - x0), dst + x0);
+                else
+                    accumulateSpan(sums.data() + 4 * x0, row, x1 - x0);
+            }
+            if (count > 1)
+                resolveSpan(dst, sums.data(), width, half, reciprocal);
+        }
+    });
+}
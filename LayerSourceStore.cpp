@@ -0,0 +1,175 @@
+#include "LayerSourceStore.h"
+
+#include <QMutexLocker>
+#include <cstring>
+
+namespace {
+
+// FNV-1a over 64 bit words
+const quint64 kHashSeed = 14695981039346656037ull;
+const quint64 kHashPrime = 1099511628211ull;
+
+inline void mix(quint64& hash, quint64 value) {
+    hash = (hash ^ value) * kHashPrime;
+}
+
+inline void mix(quint64& hash, double value) {
+    quint64 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    mix(hash, bits);
+}
+
+inline void mix(quint64& hash, const GameFusion::Vector3D& v) {
+    mix(hash, double(v.x()));
+    mix(hash, double(v.y()));
+}
+
+// Approximate heap size of a stroke list, for the content budget
+qint64 strokesBytes(const std::vector<GameFusion::BezierCurve>& strokes) {
+    qint64 bytes = qint64(strokes.capacity() * sizeof(GameFusion::BezierCurve));
+    for (const GameFusion::BezierCurve& curve : strokes)
+        bytes += qint64(curve.size()) * sizeof(GameFusion::BezierControl)
+                 + qint64(curve.strokePressure().size()) * sizeof(float);
+    return bytes;
+}
+
+} // namespace
+
+LayerSourceStore::LayerSourceStore(qint64 maxRasterBytes, qint64 maxContentBytes)
+    : m_contents(maxContentBytes), m_rasters(maxRasterBytes) {
+}
+
+QString LayerSourceStore::sourceKey(const GameFusion::Layer& layer) {
+    if (!layer.sourceUuid.empty())
+        return QString::fromStdString(layer.sourceUuid);
+    if (!layer.aliasUuid.empty())
+        return QString::fromStdString(layer.aliasUuid);
+    return QString::fromStdString(layer.uuid);
+}
+
+quint64 LayerSourceStore::strokesVersion(const std::vector<GameFusion::BezierCurve>& strokes) {
+    quint64 hash = kHashSeed;
+    mix(hash, quint64(strokes.size()));
+    for (const GameFusion::BezierCurve& curve : strokes) {
+        const StrokeProperties& props = curve.getStrokeProperties();
+        mix(hash, props.maxWidth);
+        mix(hash, props.minWidth);
+        mix(hash, quint64(props.variableWidthMode));
+        mix(hash, quint64(props.colorMode));
+        mix(hash, quint64(props.foregroundColor.rgba()));
+        mix(hash, quint64(props.backgroundColor.rgba()));
+
+        mix(hash, quint64(curve.size()));
+        for (const GameFusion::BezierControl& control : curve) {
+            mix(hash, control.point);
+            mix(hash, control.leftControl);
+            mix(hash, control.rightControl);
+        }
+        for (float pressure : curve.strokePressure())
+            mix(hash, double(pressure));
+    }
+    return hash;
+}
+
+LayerSourceStore::ContentPtr LayerSourceStore::content(const GameFusion::Layer& layer) {
+    const QString key = sourceKey(layer);
+    const bool isSource = key == QString::fromStdString(layer.uuid);
+    {
+        QMutexLocker lock(&m_mutex);
+        const ContentPtr* entry = m_contents.object(key);
+        if (entry && !isSource)
+            return *entry;
+    }
+
+    // Hashed and copied outside the lock
+    const quint64 version = strokesVersion(layer.strokes);
+    QMutexLocker lock(&m_mutex);
+    const ContentPtr* entry = m_contents.object(key);
+    if (entry && ((*entry)->version == version || !isSource))
+        return *entry;
+
+    auto content = std::make_shared<Content>();
+    content->key = key;
+    content->version = version;
+    content->strokes = layer.strokes;
+    // Content over the whole budget is not kept, but still handed out
+    m_contents.insert(key, new ContentPtr(content), strokesBytes(content->strokes));
+    return content;
+}
+
+QVector<LayerSourceStore::Instance> LayerSourceStore::instances(const GameFusion::Panel& panel) {
+    QVector<Instance> instances;
+    for (const GameFusion::Layer& layer : panel.layers) {
+        if (!layer.visible)
+            continue;
+        ContentPtr source = content(layer);
+        if (!source->strokes.empty())
+            instances.append({source, layer.blendMode, layer.opacity});
+    }
+    return instances;
+}
+
+quint64 LayerSourceStore::compositeVersion(const QVector<Instance>& instances) {
+    quint64 hash = kHashSeed;
+    mix(hash, quint64(instances.size()));
+    for (const Instance& instance : instances) {
+        mix(hash, quint64(qHash(instance.content->key)));
+        mix(hash, instance.content->version);
+        mix(hash, quint64(instance.blendMode));
+        mix(hash, double(instance.opacity));
+    }
+    return hash;
+}
+
+QImage LayerSourceStore::raster(const ContentPtr& content, const QSize& size, qreal scale, const RenderFunction& render) {
+    if (!content || size.isEmpty())
+        return QImage();
+
+    auto cached = [&]() -> QImage {
+        QMutexLocker lock(&m_mutex);
+        const Raster* raster = m_rasters.object(content->key);
+        if (raster && raster->version == content->version && raster->size == size)
+            return raster->image;
+        return QImage();
+    };
+
+    QImage image = cached();
+    if (!image.isNull())
+        return image;
+
+    // Another thread may have rendered it while this one waited
+    QMutexLocker renderLock(&content->renderMutex);
+    image = cached();
+    if (!image.isNull())
+        return image;
+
+    image = render(*content, size, scale);
+    QMutexLocker lock(&m_mutex);
+    // Only the newest content of a source is kept; a raster of content
+    // replaced meanwhile is returned but not cached
+    const ContentPtr* current = m_contents.object(content->key);
+    if (current && *current == content)
+        m_rasters.insert(content->key, new Raster{content->version, size, image}, image.sizeInBytes());
+    return image;
+}
+
+int LayerSourceStore::sourceCount() const {
+    QMutexLocker lock(&m_mutex);
+    return m_contents.count();
+}
+
+qint64 LayerSourceStore::contentBytes() const {
+    QMutexLocker lock(&m_mutex);
+    return m_contents.totalCost();
+}
+
+qint64 LayerSourceStore::rasterBytes() const {
+    QMutexLocker lock(&m_mutex);
+    return m_rasters.totalCost();
+}
+
+void LayerSourceStore::clear() {
+    QMutexLocker lock(&m_mutex);
+    m_contents.clear();
+    m_rasters.clear();
+}
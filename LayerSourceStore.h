@@ -0,0 +1,92 @@
+#ifndef LAYERSOURCESTORE_H
+#define LAYERSOURCESTORE_H
+
+#include <QCache>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QSize>
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "ScriptBreakdown.h"
+
+// Stroke content shared by a source layer and its instances and aliases
+// across panels, with a raster cache keyed by source and content version.
+//
+// An instance (sourceUuid) or alias (aliasUuid) resolves to its source's
+// entry and adds only its own opacity and blend mode when composited, so a
+// layer instanced in 40 panels is held and rastered once. Content is
+// reference counted: holders keep the pointer they got, and an edit of the
+// source swaps in new content with a new version, which invalidates its one
+// raster entry. The store itself keeps the most recently used contents
+// within a byte budget, so panels stepped past are dropped once nothing
+// composites them any more.
+//
+// Thread safe. Rasters are rendered on the calling thread, one at a time per
+// content, since its curves fill their flattening caches while drawn.
+class LayerSourceStore {
+public:
+    struct Content {
+        QString key;
+        quint64 version = 0;
+        std::vector<GameFusion::BezierCurve> strokes;
+        mutable QMutex renderMutex;     // serializes rastering of the curves
+    };
+    using ContentPtr = std::shared_ptr<const Content>;
+
+    // A visible layer as composited: its source content plus its own look
+    struct Instance {
+        ContentPtr content;
+        GameFusion::BlendMode blendMode = GameFusion::BlendMode::Opacity;
+        float opacity = 1.0f;
+    };
+    using RenderFunction = std::function<QImage(const Content& content, const QSize& size, qreal scale)>;
+
+    explicit LayerSourceStore(qint64 maxRasterBytes = 128ll * 1024 * 1024,
+                              qint64 maxContentBytes = 64ll * 1024 * 1024);
+
+    // Uuid of the layer whose strokes this one shows
+    static QString sourceKey(const GameFusion::Layer& layer);
+
+    // Hash of everything a stroke list is drawn from
+    static quint64 strokesVersion(const std::vector<GameFusion::BezierCurve>& strokes);
+
+    // Content of the layer's source. The source layer itself is hashed and
+    // replaces the entry when it changed; an instance or alias uses the
+    // entry as it is, and is only copied in while its source was never seen.
+    ContentPtr content(const GameFusion::Layer& layer);
+
+    // Visible, non-empty layers of a panel, bottom to top
+    QVector<Instance> instances(const GameFusion::Panel& panel);
+
+    // Version of a composite of instances; only hashes the content versions,
+    // so it costs nothing per stroke
+    static quint64 compositeVersion(const QVector<Instance>& instances);
+
+    // The content rastered at size / scale, rendered with render on a miss
+    QImage raster(const ContentPtr& content, const QSize& size, qreal scale, const RenderFunction& render);
+
+    int sourceCount() const;
+    qint64 contentBytes() const;
+    qint64 rasterBytes() const;
+    // Forget every source, e.g. when another project is opened
+    void clear();
+
+private:
+    struct Raster {
+        quint64 version = 0;
+        QSize size;
+        QImage image;
+    };
+
+    mutable QMutex m_mutex;
+    QCache<QString, ContentPtr> m_contents;   // by source key, cost is stroke bytes
+    QCache<QString, Raster> m_rasters;  // by source key, cost is image bytes
+};
+
+#endif // LAYERSOURCESTORE_H
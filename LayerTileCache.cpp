@@ -0,0 +1,497 @@
+#include "LayerTileCache.h"
+
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// True when every pixel of a premultiplied image is fully transparent
+bool isTransparent(const QImage& image) {
+    for (int y = 0; y < image.height(); ++y) {
+        const quint32* line = reinterpret_cast<const quint32*>(image.constScanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            if (line[x])
+                return false;
+        }
+    }
+    return true;
+}
+
+// Index of the tile containing tile t, levels up (floor division by 2^levels)
+int parentIndex(int t, int levels) {
+    return t >= 0 ? t >> levels : ~((~t) >> levels);
+}
+
+// Box filter of four premultiplied pixels; even and odd channels are summed
+// in parallel in 16 bit lanes
+inline quint32 average4(quint32 a, quint32 b, quint32 c, quint32 d) {
+    const quint32 mask = 0x00ff00ff;
+    quint32 rb = (a & mask) + (b & mask) + (c & mask) + (d & mask) + 0x00020002;
+    quint32 ag = ((a >> 8) & mask) + ((b >> 8) & mask) + ((c >> 8) & mask) + ((d >> 8) & mask) + 0x00020002;
+    return ((rb >> 2) & mask) | (((ag >> 2) & mask) << 8);
+}
+
+// Half resolution tile from its four children (top-left, top-right,
+// bottom-left, bottom-right); null children are empty
+QImage downsampleQuad(const QImage* children[4], int tileSize) {
+    QImage out;
+    const int half = tileSize / 2;
+    for (int q = 0; q < 4; ++q) {
+        const QImage* child = children[q];
+        if (!child || child->isNull())
+            continue;
+        if (out.isNull()) {
+            out = QImage(tileSize, tileSize, QImage::Format_ARGB32_Premultiplied);
+            out.fill(Qt::transparent);
+        }
+
+        const int ox = (q & 1) * half;
+        const int oy = (q >> 1) * half;
+        for (int y = 0; y < half; ++y) {
+            const quint32* s0 = reinterpret_cast<const quint32*>(child->constScanLine(2 * y));
+            const quint32* s1 = reinterpret_cast<const quint32*>(child->constScanLine(2 * y + 1));
+            quint32* dst = reinterpret_cast<quint32*>(out.scanLine(oy + y)) + ox;
+            for (int x = 0; x < half; ++x)
+                dst[x] = average4(s0[2 * x], s0[2 * x + 1], s1[2 * x], s1[2 * x + 1]);
+        }
+    }
+    if (!out.isNull() && isTransparent(out))
+        return QImage();
+    return out;
+}
+
+} // namespace
+
+LayerTileCache::LayerTileCache()
+    : m_mips(MaxMipLevel),
+      m_mipWatcher(new QFutureWatcher<MipBuildResult>()),
+      m_tileWatchers(new QObject()) {
+    QObject::connect(m_mipWatcher.get(), &QFutureWatcherBase::finished, m_mipWatcher.get(), [this]() {
+        applyMipBuild();
+    });
+}
+
+// Running builds and tile tasks only hold copies of the tiles and primitives;
+// their results are dropped with the watchers
+LayerTileCache::~LayerTileCache() = default;
+
+void LayerTileCache::clear() {
+    m_primitives.clear();
+    m_tiles.clear();
+    for (auto& level : m_mips)
+        level.clear();
+    // m_generation keeps counting so results of a build or tile task started
+    // before the clear can never pass for fresh
+}
+
+QRect LayerTileCache::tileRange(const QRectF& rect, int tileSize) {
+    int x0 = static_cast<int>(std::floor(rect.left() / tileSize));
+    int y0 = static_cast<int>(std::floor(rect.top() / tileSize));
+    int x1 = static_cast<int>(std::ceil(rect.right() / tileSize)) - 1;
+    int y1 = static_cast<int>(std::ceil(rect.bottom() / tileSize)) - 1;
+    return QRect(QPoint(x0, y0), QPoint(std::max(x0, x1), std::max(y0, y1)));
+}
+
+int LayerTileCache::mipLevelForScale(qreal scale) {
+    if (scale <= 0.0 || scale >= 1.0)
+        return 0;
+    int level = static_cast<int>(std::floor(-std::log2(scale) + 0.5));
+    return std::clamp(level, 0, MaxMipLevel);
+}
+
+void LayerTileCache::markChanged(Tile& tile, int tx, int ty) {
+    ++m_generation;
+    tile.version = m_generation;
+    for (int level = 1; level <= MaxMipLevel; ++level) {
+        quint64 key = tileKey(parentIndex(tx, level), parentIndex(ty, level));
+        m_mips[level - 1][key].changedGeneration = m_generation;
+    }
+}
+
+void LayerTileCache::invalidate(const QRectF& rect) {
+    if (rect.isEmpty()) return;
+
+    const QRect range = tileRange(rect);
+    for (int ty = range.top(); ty <= range.bottom(); ++ty) {
+        for (int tx = range.left(); tx <= range.right(); ++tx) {
+            Tile& tile = m_tiles[tileKey(tx, ty)];
+            tile.dirty = true;
+            markChanged(tile, tx, ty);
+        }
+    }
+}
+
+void LayerTileCache::paintPrimitive(QPainter& painter, const RasterPrimitive& primitive) {
+    painter.save();
+    painter.setTransform(primitive.transform, true);
+    painter.setPen(primitive.pen);
+    painter.setBrush(primitive.brush);
+    painter.drawPath(primitive.path);
+    painter.restore();
+}
+
+int LayerTileCache::append(RasterPrimitive primitive) {
+    primitive.id = m_nextPrimitiveId++;
+    m_primitives.append(primitive);
+
+    const QRectF& rect = primitive.bounds;
+    if (rect.isEmpty()) return primitive.id;
+
+    const QRect range = tileRange(rect);
+    for (int ty = range.top(); ty <= range.bottom(); ++ty) {
+        for (int tx = range.left(); tx <= range.right(); ++tx) {
+            auto it = m_tiles.find(tileKey(tx, ty));
+            if (it == m_tiles.end()) {
+                // Dirty, rastered on paint
+                markChanged(m_tiles[tileKey(tx, ty)], tx, ty);
+                continue;
+            }
+
+            // Also voids a task in flight: its snapshot predates the primitive
+            Tile& tile = it.value();
+            markChanged(tile, tx, ty);
+
+            const QRect area = tileRect(tx, ty);
+            if (tile.image.isNull()) {
+                if (tile.dirty)
+                    continue;  // nothing to preview on, the raster task draws it
+                // Empty tile: the new content is all there is
+                tile.image = QImage(TileSize, TileSize, QImage::Format_ARGB32_Premultiplied);
+                tile.image.fill(Qt::transparent);
+            }
+
+            // Clean tiles are final after this; dirty ones show it until
+            // their re-raster lands
+            QPainter p(&tile.image);
+            p.setRenderHint(QPainter::Antialiasing, true);
+            p.setRenderHint(QPainter::SmoothPixmapTransform, true);
+            p.translate(-area.topLeft());
+            p.setClipRect(area.intersected(rect.toAlignedRect()));
+            paintPrimitive(p, primitive);
+        }
+    }
+    return primitive.id;
+}
+
+void LayerTileCache::remove(int id) {
+    auto it = std::find_if(m_primitives.begin(), m_primitives.end(),
+                           [id](const RasterPrimitive& primitive) { return primitive.id == id; });
+    if (it == m_primitives.end()) return;
+
+    const QRectF rect = it->bounds;
+    m_primitives.erase(it);
+    invalidate(rect);
+}
+
+QVector<int> LayerTileCache::replace(int id, QVector<RasterPrimitive> primitives) {
+    QVector<int> ids;
+    auto it = std::find_if(m_primitives.begin(), m_primitives.end(),
+                           [id](const RasterPrimitive& primitive) { return primitive.id == id; });
+    if (it == m_primitives.end()) return ids;
+
+    QRectF rect = it->bounds;
+    int at = int(it - m_primitives.begin());
+    m_primitives.remove(at);
+    for (RasterPrimitive& primitive : primitives) {
+        primitive.id = m_nextPrimitiveId++;
+        ids.append(primitive.id);
+        rect = rect.united(primitive.bounds);
+        m_primitives.insert(at++, primitive);
+    }
+    invalidate(rect);
+    return ids;
+}
+
+int LayerTileCache::insert(int beforeId, RasterPrimitive primitive) {
+    auto it = std::find_if(m_primitives.begin(), m_primitives.end(),
+                           [beforeId](const RasterPrimitive& p) { return p.id == beforeId; });
+    if (it == m_primitives.end()) return append(primitive);
+
+    primitive.id = m_nextPrimitiveId++;
+    const QRectF rect = primitive.bounds;
+    m_primitives.insert(int(it - m_primitives.begin()), primitive);
+    invalidate(rect);
+    return primitive.id;
+}
+
+QImage LayerTileCache::rasterTile(const QVector<RasterPrimitive>& primitives, const QRect& area) {
+    const QRectF areaF(area);
+    QImage image;
+    for (const RasterPrimitive& primitive : primitives) {
+        if (!primitive.bounds.intersects(areaF))
+            continue;
+        if (image.isNull()) {
+            image = QImage(TileSize, TileSize, QImage::Format_ARGB32_Premultiplied);
+            image.fill(Qt::transparent);
+        }
+        QPainter p(&image);
+        p.setRenderHint(QPainter::Antialiasing, true);
+        p.setRenderHint(QPainter::SmoothPixmapTransform, true);
+        p.translate(-area.topLeft());
+        p.setClipRect(area);
+        paintPrimitive(p, primitive);
+    }
+
+    // Content bounding boxes overlap tiles they never ink; keep those empty
+    if (!image.isNull() && isTransparent(image))
+        return QImage();
+    return image;
+}
+
+void LayerTileCache::scheduleTile(quint64 key, Tile& tile) {
+    if (tile.pendingVersion != 0)
+        return;  // re-queued when the running task lands stale
+
+    tile.pendingVersion = tile.version;
+    ++m_pendingTiles;
+
+    const quint64 version = tile.version;
+    auto* watcher = new QFutureWatcher<QImage>(m_tileWatchers.get());
+    QObject::connect(watcher, &QFutureWatcherBase::finished, watcher, [this, watcher, key, version]() {
+        applyTile(key, version, watcher->result());
+        watcher->deleteLater();
+    });
+    // The primitive list is shared with the task until the GUI thread edits it
+    watcher->setFuture(QtConcurrent::run(&LayerTileCache::rasterTile, m_primitives,
+                                         tileRect(tileX(key), tileY(key))));
+}
+
+void LayerTileCache::applyTile(quint64 key, quint64 version, const QImage& image) {
+    --m_pendingTiles;
+
+    // The tile may have been cleared and recreated since; only its own task
+    // releases it
+    auto it = m_tiles.find(key);
+    if (it != m_tiles.end() && it->pendingVersion == version) {
+        it->pendingVersion = 0;
+        if (it->version == version) {
+            it->image = image;
+            it->dirty = false;
+        }
+        // Changed while rastering: stays dirty, the repaint below queues it again
+    }
+
+    if (m_update)
+        m_update();
+}
+
+template <typename Fn>
+void LayerTileCache::forEachLevel0Tile(const QRect& range, Fn fn) {
+    const qint64 visibleTiles = qint64(range.width()) * range.height();
+    if (visibleTiles <= m_tiles.size()) {
+        for (int ty = range.top(); ty <= range.bottom(); ++ty) {
+            for (int tx = range.left(); tx <= range.right(); ++tx) {
+                auto it = m_tiles.find(tileKey(tx, ty));
+                if (it != m_tiles.end())
+                    fn(it.key(), it.value(), tx, ty);
+            }
+        }
+    } else {
+        // Zoomed far out: walk the existing tiles instead of the visible range
+        for (auto it = m_tiles.begin(); it != m_tiles.end(); ++it) {
+            int tx = tileX(it.key());
+            int ty = tileY(it.key());
+            if (range.contains(tx, ty))
+                fn(it.key(), it.value(), tx, ty);
+        }
+    }
+}
+
+void LayerTileCache::paintLevel0(QPainter* painter, const QRect& range) {
+    forEachLevel0Tile(range, [&](quint64 key, Tile& tile, int tx, int ty) {
+        if (tile.dirty)
+            scheduleTile(key, tile);
+        // A dirty tile keeps showing its previous image until the new one lands
+        if (!tile.image.isNull())
+            painter->drawImage(tileRect(tx, ty).topLeft(), tile.image);
+    });
+}
+
+QVector<LayerTileCache::TileImage> LayerTileCache::level0Tiles(const QRectF& rect) {
+    QVector<TileImage> tiles;
+    if (m_tiles.isEmpty() || rect.isEmpty()) return tiles;
+
+    forEachLevel0Tile(tileRange(rect), [&](quint64 key, Tile& tile, int tx, int ty) {
+        if (tile.dirty)
+            scheduleTile(key, tile);
+        if (!tile.image.isNull())
+            tiles.append({tileRect(tx, ty).topLeft(), tile.image});
+    });
+    return tiles;
+}
+
+void LayerTileCache::rasterDirtyTiles(const QRectF& rect) {
+    if (m_tiles.isEmpty() || rect.isEmpty()) return;
+
+    QVector<quint64> keys;
+    forEachLevel0Tile(tileRange(rect), [&](quint64 key, Tile& tile, int, int) {
+        if (tile.dirty)
+            keys.append(key);
+    });
+    if (keys.isEmpty()) return;
+
+    // Same raster as the background tasks; one still in flight for a tile
+    // lands later with an identical image
+    const QVector<RasterPrimitive> primitives = m_primitives;
+    const QVector<QImage> images = QtConcurrent::blockingMapped<QVector<QImage>>(keys, [primitives](quint64 key) {
+        return rasterTile(primitives, tileRect(tileX(key), tileY(key)));
+    });
+    for (int i = 0; i < keys.size(); ++i) {
+        Tile& tile = m_tiles[keys[i]];
+        tile.image = images[i];
+        tile.dirty = false;
+    }
+}
+
+void LayerTileCache::paint(QPainter* painter, const QRectF& exposedRect) {
+    if (m_tiles.isEmpty() || exposedRect.isEmpty()) return;
+
+    const qreal scale = QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform());
+    const int level = mipLevelForScale(scale);
+    if (level == 0) {
+        paintLevel0(painter, tileRange(exposedRect));
+        return;
+    }
+
+    const int size = TileSize << level;
+    const QRect range = tileRange(exposedRect, size);
+    QHash<quint64, MipTile>& mips = m_mips[level - 1];
+    QVector<quint64> stale;
+
+    auto paintMip = [&](quint64 key, const MipTile& mip) {
+        const int tx = tileX(key);
+        const int ty = tileY(key);
+        if (mip.builtGeneration >= mip.changedGeneration) {
+            if (!mip.image.isNull())
+                painter->drawImage(QRect(tx * size, ty * size, size, size), mip.image);
+            return;
+        }
+        // Not built yet or outdated: full resolution until the build lands
+        stale.append(key);
+        const int span = 1 << level;
+        paintLevel0(painter, QRect(tx * span, ty * span, span, span));
+    };
+
+    if (qint64(range.width()) * range.height() <= mips.size()) {
+        for (int ty = range.top(); ty <= range.bottom(); ++ty) {
+            for (int tx = range.left(); tx <= range.right(); ++tx) {
+                auto it = mips.constFind(tileKey(tx, ty));
+                if (it != mips.constEnd())
+                    paintMip(it.key(), it.value());
+            }
+        }
+    } else {
+        for (auto it = mips.cbegin(); it != mips.cend(); ++it) {
+            if (range.contains(tileX(it.key()), tileY(it.key())))
+                paintMip(it.key(), it.value());
+        }
+    }
+
+    if (!stale.isEmpty())
+        requestMipBuild(level, stale);
+}
+
+void LayerTileCache::requestMipBuild(int level, const QVector<quint64>& staleKeys) {
+    // One build at a time; the repaint after it lands asks again for whatever
+    // is still stale
+    if (m_mipWatcher->isRunning())
+        return;
+
+    // Mips are built from final level 0 tiles only. Dirty ones are queued
+    // instead and the build is asked for again once they land. QImage copies
+    // are shared until the GUI thread paints into a tile again, which then
+    // detaches.
+    QHash<quint64, QImage> base;
+    bool complete = true;
+    const int span = 1 << level;
+    for (quint64 key : staleKeys) {
+        const int x0 = tileX(key) * span;
+        const int y0 = tileY(key) * span;
+        for (int ty = y0; ty < y0 + span; ++ty) {
+            for (int tx = x0; tx < x0 + span; ++tx) {
+                auto it = m_tiles.find(tileKey(tx, ty));
+                if (it == m_tiles.end())
+                    continue;
+                if (it->dirty) {
+                    scheduleTile(it.key(), it.value());
+                    complete = false;
+                }
+                base.insert(it.key(), it->image);
+            }
+        }
+    }
+    if (!complete)
+        return;
+
+    m_mipWatcher->setFuture(QtConcurrent::run(&LayerTileCache::buildMips, m_generation, level, base));
+}
+
+LayerTileCache::MipBuildResult LayerTileCache::buildMips(quint64 generation, int level, const QHash<quint64, QImage>& base) {
+    MipBuildResult result;
+    result.generation = generation;
+    result.levels.reserve(level);
+
+    const QHash<quint64, QImage>* below = &base;
+    for (int l = 1; l <= level; ++l) {
+        // Every parent of an existing tile gets an entry, empty ones included,
+        // so the GUI side can mark them built
+        QHash<quint64, QImage> current;
+        for (auto it = below->cbegin(); it != below->cend(); ++it) {
+            quint64 parent = tileKey(parentIndex(tileX(it.key()), 1), parentIndex(tileY(it.key()), 1));
+            if (current.contains(parent))
+                continue;
+
+            const int px = tileX(parent);
+            const int py = tileY(parent);
+            const QImage* children[4];
+            for (int q = 0; q < 4; ++q) {
+                auto child = below->constFind(tileKey(2 * px + (q & 1), 2 * py + (q >> 1)));
+                children[q] = child != below->cend() ? &child.value() : nullptr;
+            }
+            current.insert(parent, downsampleQuad(children, TileSize));
+        }
+        result.levels.append(current);
+        below = &result.levels.last();
+    }
+    return result;
+}
+
+void LayerTileCache::applyMipBuild() {
+    const MipBuildResult result = m_mipWatcher->result();
+    for (int l = 0; l < result.levels.size(); ++l) {
+        QHash<quint64, MipTile>& mips = m_mips[l];
+        const QHash<quint64, QImage>& built = result.levels[l];
+        for (auto it = built.cbegin(); it != built.cend(); ++it) {
+            auto mip = mips.find(it.key());
+            // Tiles changed while the build ran keep waiting for the next one
+            if (mip == mips.end() || mip->changedGeneration > result.generation)
+                continue;
+            mip->image = it.value();
+            mip->builtGeneration = result.generation;
+        }
+    }
+
+    if (m_update)
+        m_update();
+}
+
+QRect LayerTileCache::bounds() const {
+    QRect result;
+    for (auto it = m_tiles.cbegin(); it != m_tiles.cend(); ++it)
+        result = result.united(tileRect(tileX(it.key()), tileY(it.key())));
+    return result;
+}
+
+qint64 LayerTileCache::memoryBytes() const {
+    qint64 bytes = 0;
+    for (auto it = m_tiles.cbegin(); it != m_tiles.cend(); ++it)
+        bytes += it.value().image.sizeInBytes();
+    for (const auto& level : m_mips) {
+        for (auto it = level.cbegin(); it != level.cend(); ++it)
+            bytes += it.value().image.sizeInBytes();
+    }
+    return bytes;
+}
@@ -0,0 +1,187 @@
+#ifndef LAYERTILECACHE_H
+#define LAYERTILECACHE_H
+
+#include <functional>
+#include <memory>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QImage>
+#include <QBrush>
+#include <QObject>
+#include <QPainterPath>
+#include <QPen>
+#include <QPoint>
+#include <QRect>
+#include <QRectF>
+#include <QTransform>
+#include <QVector>
+
+class QPainter;
+
+// Immutable copy of one vector item of a layer. Path, pen and brush are
+// implicitly shared values, so snapshots can be painted on worker threads
+// while the GUI thread keeps editing the scene items they came from.
+struct RasterPrimitive {
+    int id = -1;
+    QPainterPath path;
+    QPen pen = QPen(Qt::NoPen);
+    QBrush brush;
+    QTransform transform;   // item to layer coordinates
+    QRectF bounds;          // layer coordinates, pen included
+};
+
+// Raster cache of one layer split into fixed-size premultiplied ARGB tiles.
+// Tiles only exist where content was added and dirty rectangles re-raster
+// only the tiles they touch.
+//
+// The cache owns a snapshot of the layer's primitives. Dirty tiles visible in
+// a paint are rastered from it on the global thread pool, one task per tile;
+// the GUI thread only swaps in finished images. Until a tile lands its
+// previous image (if any) is drawn, so the layer fills in progressively.
+//
+// On top of the full resolution tiles the cache keeps a mip pyramid: level n
+// tiles are TileSize pixels wide but cover TileSize << n layer units. Mip tiles
+// are box filtered from the level below on a worker thread, only for the area
+// that was actually painted zoomed out, and level 0 stands in until they land.
+class LayerTileCache {
+public:
+    static const int TileSize = 256;
+    static const int MaxMipLevel = 4;   // 1/16 scale
+
+    LayerTileCache();
+    ~LayerTileCache();
+
+    LayerTileCache(const LayerTileCache&) = delete;
+    LayerTileCache& operator=(const LayerTileCache&) = delete;
+
+    // Called on the GUI thread when background tiles are ready to be drawn
+    void setUpdateFunction(const std::function<void()>& update) { m_update = update; }
+
+    // Drop every primitive and tile (full rebuild)
+    void clear();
+
+    // Primitive drawn on top of everything else: clean tiles under its bounds
+    // are painted over on the spot, missing tiles are created dirty. Returns
+    // the id to remove it with.
+    int append(RasterPrimitive primitive);
+
+    // Remove a primitive and re-raster the tiles it covered
+    void remove(int id);
+
+    // Put primitives in the place of one in the paint order (e.g. the pieces
+    // left of an erased stroke) and re-raster the tiles covered. Returns the
+    // ids of the new primitives, none if id was not found.
+    QVector<int> replace(int id, QVector<RasterPrimitive> primitives);
+
+    // Put a primitive in the paint order just under another (e.g. a stroke
+    // brought back by undo) and re-raster the tiles it covers; appended when
+    // beforeId is not found. Returns its id.
+    int insert(int beforeId, RasterPrimitive primitive);
+
+    // Content changed inside rect: tiles are created where missing and
+    // re-rastered on next paint
+    void invalidate(const QRectF& rect);
+
+    // Draw the tiles intersecting exposedRect from the mip level closest to
+    // the painter scale; dirty level 0 tiles are queued for rastering
+    void paint(QPainter* painter, const QRectF& exposedRect);
+
+    // Level 0 tile with its top-left corner in layer coordinates
+    struct TileImage {
+        QPoint pos;
+        QImage image;
+    };
+
+    // The non-empty level 0 tiles intersecting rect, for use without a
+    // painter (e.g. blended directly by the compositor). Dirty tiles are
+    // queued and returned with their previous image, as paint() draws them.
+    QVector<TileImage> level0Tiles(const QRectF& rect);
+
+    // Raster the dirty tiles intersecting rect right away, in parallel, for
+    // output that cannot wait for the background tasks (export)
+    void rasterDirtyTiles(const QRectF& rect);
+
+    // Tile raster tasks queued or running; 0 once everything painted so far
+    // is up to date
+    int pendingTileCount() const { return m_pendingTiles; }
+    bool isReady() const { return m_pendingTiles == 0; }
+
+    // Draw one primitive into a painter set up in layer coordinates
+    static void paintPrimitive(QPainter& painter, const RasterPrimitive& primitive);
+
+    // Mip level matching a layer-to-device scale factor
+    static int mipLevelForScale(qreal scale);
+
+    // Bounding rect of all tiles, in layer coordinates
+    QRect bounds() const;
+
+    int tileCount() const { return m_tiles.size(); }
+    qint64 memoryBytes() const;
+
+private:
+    // version is the generation of the last change to the tile; a raster
+    // task only lands if the tile was not changed again while it ran
+    struct Tile {
+        QImage image;       // null until rastered, or when the tile is empty
+        bool dirty = true;
+        quint64 version = 0;
+        quint64 pendingVersion = 0;     // version of the task in flight, 0 if none
+    };
+
+    // Mip tiles are stale while the generation they were built from is older
+    // than the last change to any level 0 tile they cover
+    struct MipTile {
+        QImage image;
+        quint64 builtGeneration = 0;
+        quint64 changedGeneration = 0;
+    };
+
+    // Output of a background build: per level (index 0 = level 1) the
+    // downsampled tiles, all built from the level 0 snapshot of generation
+    struct MipBuildResult {
+        quint64 generation = 0;
+        QVector<QHash<quint64, QImage>> levels;
+    };
+
+    static quint64 tileKey(int tx, int ty) {
+        return (quint64(quint32(tx)) << 32) | quint32(ty);
+    }
+    static QRect tileRect(int tx, int ty) {
+        return QRect(tx * TileSize, ty * TileSize, TileSize, TileSize);
+    }
+    static int tileX(quint64 key) { return static_cast<int>(quint32(key >> 32)); }
+    static int tileY(quint64 key) { return static_cast<int>(quint32(key)); }
+    // Inclusive range of tile indices covering rect, for tiles of the given size
+    static QRect tileRange(const QRectF& rect, int tileSize = TileSize);
+
+    // Queue a dirty tile on the thread pool (no-op while its task runs)
+    void scheduleTile(quint64 key, Tile& tile);
+    void applyTile(quint64 key, quint64 version, const QImage& image);
+    static QImage rasterTile(const QVector<RasterPrimitive>& primitives, const QRect& area);
+
+    // Call fn(key, tile, tx, ty) for the existing tiles in a tile index range
+    template <typename Fn> void forEachLevel0Tile(const QRect& range, Fn fn);
+    void paintLevel0(QPainter* painter, const QRect& range);
+    // Level 0 tile changed: stamp every mip tile above it and the tile itself
+    void markChanged(Tile& tile, int tx, int ty);
+    // Snapshot the level 0 tiles under the given mip tiles and downsample them
+    // up to level on the thread pool, once all of them are rastered
+    void requestMipBuild(int level, const QVector<quint64>& staleKeys);
+    void applyMipBuild();
+
+    static MipBuildResult buildMips(quint64 generation, int level, const QHash<quint64, QImage>& base);
+
+    QVector<RasterPrimitive> m_primitives;      // paint order; tasks hold copies
+    int m_nextPrimitiveId = 0;
+    QHash<quint64, Tile> m_tiles;
+    QVector<QHash<quint64, MipTile>> m_mips;    // index 0 = level 1
+    quint64 m_generation = 0;
+    int m_pendingTiles = 0;
+    std::function<void()> m_update;
+
+    std::unique_ptr<QFutureWatcher<MipBuildResult>> m_mipWatcher;
+    // Parent of the per-tile watchers; deleting it drops results still in flight
+    std::unique_ptr<QObject> m_tileWatchers;
+};
+
+#endif // LAYERTILECACHE_H
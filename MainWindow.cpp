@@ -1444,6 +1444,35 @@ private:
     MainWindow* m_mainWindow;
 };
 
+// Erase drag as a delta: only the strokes the eraser cut, with the pieces put
+// in their place, rather than copies of the whole layer before and after.
+// The canvas already did the edits when the command is pushed, so the first
+// redo only brings the panel up to date.
+class LayerStrokeEraseCommand : public QUndoCommand {
+public:
+    LayerStrokeEraseCommand(const std::vector<GameFusion::StrokeErase>& edits,
+                            const QString& layerUuid, const QString& panelUuid, MainWindow* mainWindow)
+        : m_edits(edits), m_layerUuid(layerUuid), m_panelUuid(panelUuid), m_mainWindow(mainWindow) {
+        setText("Erase Stroke");
+    }
+
+    void undo() override {
+        m_mainWindow->eraseLayerStrokes(m_layerUuid, m_panelUuid, m_edits, true, true);
+    }
+
+    void redo() override {
+        m_mainWindow->eraseLayerStrokes(m_layerUuid, m_panelUuid, m_edits, false, !m_firstRedo);
+        m_firstRedo = false;
+    }
+
+private:
+    std::vector<GameFusion::StrokeErase> m_edits;
+    QString m_layerUuid;
+    QString m_panelUuid;
+    MainWindow* m_mainWindow;
+    bool m_firstRedo = true;
+};
+
 class ClearLayerCommand : public QUndoCommand {
 public:
     ClearLayerCommand(const GameFusion::Layer& originalLayer, const GameFusion::Layer& clearedLayer,
@@ -2564,6 +2593,9 @@ MainWindow::MainWindow(QWidget *parent)
     connect(strokeDock, &StrokeAttributeDockWidget::strokePropertiesChanged,
             paintCanvas, &PaintCanvas::setStrokeProperties);
 
+    connect(paintCanvas, &PaintCanvas::strokesErased,
+            this, &MainWindow::onPaintCanvasStrokesErased);
+
     const StrokeProperties initialStrokeProperties = strokeDock->getStrokeProperties();
     paint->getPaintArea()->setStrokeProperties(initialStrokeProperties);
     paintCanvas->setStrokeProperties(initialStrokeProperties);
@@ -4527,6 +4559,9 @@ void MainWindow::loadProject(QString projectDir){
 
     paint->newImage();
 
+    if (paintCanvas)
+        paintCanvas->clearLayerSources();
+
     QString projectFilePath = QDir(projectDir).filePath("project.json");
     QJsonDocument projectDoc;
     QString errorMsg;
@@ -5925,6 +5960,13 @@ void MainWindow::onPaintAreaEraseStrokes(const Layer &modLayer) {
     return;
 }
 
+void MainWindow::onPaintCanvasStrokesErased(const QString& layerUuid, const std::vector<GameFusion::StrokeErase>& edits) {
+    if (!currentPanel || edits.empty()) return;
+
+    undoStack->push(new LayerStrokeEraseCommand(edits, layerUuid,
+                                                QString::fromStdString(currentPanel->uuid), this));
+}
+
 void MainWindow::onPaintAreaLayerAdded(const Layer& layer) {
     // 1. Add to current panel's layers
     if (currentPanel){
@@ -10981,6 +11023,29 @@ void MainWindow::onLayerPositionChanged(const QString& layerUuid, double oldX, d
                                              oldX, oldY, newX, newY, this));
 }
 
+void MainWindow::eraseLayerStrokes(const QString& layerUuid, const QString& panelUuid,
+                                   const std::vector<GameFusion::StrokeErase>& edits, bool revert, bool updateCanvas) {
+    PanelContext panelContext = findPanelByUuid(panelUuid.toStdString());
+    if (!panelContext.isValid()) return;
+
+    auto it = std::find_if(panelContext.panel->layers.begin(), panelContext.panel->layers.end(),
+                           [&](const GameFusion::Layer& l) { return l.uuid == layerUuid.toStdString(); });
+    if (it == panelContext.panel->layers.end()) return;
+
+    if (revert)
+        GameFusion::StrokeEraser::revert(it->strokes, edits);
+    else
+        GameFusion::StrokeEraser::apply(it->strokes, edits);
+
+    panelContext.scene->dirty = true;
+    updateWindowTitle(true);
+
+    // The canvas only re-rasters the tiles under the edited strokes; it shows
+    // the current panel only, so edits to another panel stop at the model
+    if (updateCanvas && paintCanvas && panelContext.panel == currentPanel)
+        paintCanvas->applyStrokeErase(layerUuid, edits, revert);
+}
+
 void MainWindow::setKeyFramePosition(const QString& layerUuid, const QString& panelUuid, int keyFrameIndex, double x, double y) {
 
     LayerContext layerContext = findLayerByUuid(panelUuid.toStdString(), layerUuid.toStdString());
@@ -163,6 +163,9 @@ public:
     void updateKeyframe(const QString& kfUuid, double timeMs, const QVariant& value, const QString& layerUuid, const QString& panelUuid, const QString& shotUuid); //
     void setKeyFramePosition(const QString& layerUuid, const QString& panelUuid, int keyFrameIndex, double x, double y); // paint area edits
     void setLayerPosition(const QString& layerUuid, const QString& panelUuid, double x, double y); // paint area edits
+    void eraseLayerStrokes(const QString& layerUuid, const QString& panelUuid,
+                           const std::vector<GameFusion::StrokeErase>& edits, bool revert,
+                           bool updateCanvas); // paint canvas erase undo/redo
     void deleteKeyframe(const QString& kfUuid, double time, const QVariantMap& value,
                         const QString& layerUuid, const QString& panelUuid, const QString& shotUuid, double cursorTime);
 
@@ -305,6 +308,7 @@ public slots:
     void onPaintAreaLayerAdded(const GameFusion::Layer& layer);
     void onPaintAreaLayerModified(const GameFusion::Layer& layer);
     void onPaintAreaEraseStrokes(const GameFusion::Layer& layer);
+    void onPaintCanvasStrokesErased(const QString& layerUuid, const std::vector<GameFusion::StrokeErase>& edits);
     void onKeyFramePositionChanged(const QString& layerUuid, int keyFrameIndex, double oldX, double oldY, double newX, double newY);
     void onLayerPositionChanged(const QString& layerUuid, double oldX, double oldY, double newX, double newY, bool isEditing);
 
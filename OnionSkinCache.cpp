@@ -0,0 +1,54 @@
+#include "OnionSkinCache.h"
+
+#include <QFutureWatcher>
+#include <QtConcurrent>
+
+OnionSkinCache::OnionSkinCache(qint64 maxBytes)
+    : m_cache(maxBytes),
+      m_watchers(new QObject()) {
+}
+
+OnionSkinCache::~OnionSkinCache() = default;
+
+bool OnionSkinCache::needs(const QString& uuid, quint64 version) const {
+    auto pending = m_pending.constFind(uuid);
+    if (pending != m_pending.cend() && pending.value() == version)
+        return false;
+    const Entry* entry = m_cache.object(uuid);
+    return !entry || entry->version != version;
+}
+
+void OnionSkinCache::request(const QString& uuid, quint64 version, RenderFunction render) {
+    if (!needs(uuid, version))
+        return;
+
+    // A render of an older version keeps running; its result is dropped
+    m_pending.insert(uuid, version);
+    auto* watcher = new QFutureWatcher<QImage>(m_watchers.get());
+    QObject::connect(watcher, &QFutureWatcherBase::finished, watcher, [this, watcher, uuid, version]() {
+        apply(uuid, version, watcher->result());
+        watcher->deleteLater();
+    });
+    watcher->setFuture(QtConcurrent::run(std::move(render)));
+}
+
+void OnionSkinCache::apply(const QString& uuid, quint64 version, const QImage& image) {
+    auto pending = m_pending.find(uuid);
+    if (pending == m_pending.end() || pending.value() != version)
+        return;  // superseded while rendering
+    m_pending.erase(pending);
+
+    m_cache.insert(uuid, new Entry{version, image}, image.sizeInBytes());
+    if (m_update)
+        m_update(uuid);
+}
+
+QImage OnionSkinCache::composite(const QString& uuid) const {
+    const Entry* entry = m_cache.object(uuid);
+    return entry ? entry->image : QImage();
+}
+
+void OnionSkinCache::clear() {
+    m_cache.clear();
+    m_pending.clear();
+}
@@ -0,0 +1,72 @@
+#ifndef ONIONSKINCACHE_H
+#define ONIONSKINCACHE_H
+
+#include <QCache>
+#include <QColor>
+#include <QHash>
+#include <QImage>
+#include <QObject>
+#include <QString>
+#include <QtGlobal>
+#include <functional>
+#include <memory>
+
+// How the neighbouring panels are drawn under the active one
+struct OnionSkinSettings {
+    int depth = 1;                              // panels shown on each side
+    QColor previousTint = QColor(220, 50, 50);
+    QColor nextTint = QColor(50, 170, 70);
+    float opacity = 0.5f;                       // of the nearest panel on each side
+    float falloff = 0.5f;                       // opacity factor per step further away
+    qreal scale = 0.5;                          // composite resolution relative to the canvas
+};
+
+// LRU cache of flattened, downscaled panel composites for onion skinning and
+// the light table, keyed by panel uuid and content version.
+//
+// A missing or outdated composite is rendered on the global thread pool from
+// a render function that owns what it draws; versions come from
+// LayerSourceStore::compositeVersion(). The previous composite of
+// a panel stays available until the new one lands, so editing a neighbour
+// never blanks its onion skin. The cache is bounded by image memory; the
+// least recently looked up composites go first.
+class OnionSkinCache {
+public:
+    using RenderFunction = std::function<QImage()>;
+
+    explicit OnionSkinCache(qint64 maxBytes = 256ll * 1024 * 1024);
+    ~OnionSkinCache();
+
+    // Called on the GUI thread each time a composite lands
+    void setUpdateFunction(const std::function<void(const QString& uuid)>& update) { m_update = update; }
+
+    // True when version is neither cached nor being rendered; only then is
+    // request() worth building a render function for
+    bool needs(const QString& uuid, quint64 version) const;
+    void request(const QString& uuid, quint64 version, RenderFunction render);
+
+    // Latest composite of the panel, possibly of an older version; null if
+    // none was rendered yet. Marks it as recently used.
+    QImage composite(const QString& uuid) const;
+
+    void clear();
+    qint64 memoryBytes() const { return m_cache.totalCost(); }
+
+private:
+    struct Entry {
+        quint64 version = 0;
+        QImage image;
+    };
+
+    void apply(const QString& uuid, quint64 version, const QImage& image);
+
+    QCache<QString, Entry> m_cache;     // cost is image bytes
+    QHash<QString, quint64> m_pending;  // uuid -> version being rendered
+    std::function<void(const QString&)> m_update;
+
+    // Parent of the in-flight task watchers; results of tasks still running
+    // when the cache goes away are dropped with it
+    std::unique_ptr<QObject> m_watchers;
+};
+
+#endif // ONIONSKINCACHE_H
@@ -5,6 +5,7 @@
 #include <QMessageBox>
 #include <QMenu>
 #include <QThread>
+#include <QtConcurrent>
 
 #include <QOpenGLWidget>
 #include <QSurfaceFormat>
@@ -20,10 +21,29 @@
 
 #include <QPainter>
 #include <QPainterPath>
+#include <QtMath>
+#include <cmath>
 #include "BezierCurve.h"
 
 bool PaintCanvas::m_verbose = false;
 
+// Max distance (px) between a flattened curve and the true Bézier. Layer tiles
+// are rastered at layer resolution, so for them it is in layer units; items
+// drawn live by the view divide it by the zoom.
+static const float kCurveTolerance = 0.25f;
+
+// Pick radius of the Bézier edit handles, in screen pixels
+static const qreal kEditHandleHitRadius = 6.0;
+
+// PiP preview size, as a fraction of the base canvas
+static const qreal kPipDownscale = 9.0;
+
+// Motion blur: shutter open time in frames, spacing of the sub-frame samples
+// in screen pixels travelled, and the most sub-frames averaged per layer
+static const double kMotionBlurShutter = 0.5;
+static const double kMotionBlurPixelsPerSample = 1.0;
+static const int kMaxMotionBlurSamples = 32;
+
 PaintCanvas::PaintCanvas(QWidget *parent) :
     QGraphicsView(parent),
     //theImage(1920, 1080, QImage::Format_RGB32),
@@ -98,8 +118,30 @@ PaintCanvas::PaintCanvas(QWidget *parent) :
     m_cameraMotionPathItem = new QGraphicsPathItem;
     m_cameraMotionPathItem->setPen(QPen(Qt::cyan, 2, Qt::DashLine));
     m_scene->addItem(m_cameraMotionPathItem);
-    m_editBezierGroup = new QGraphicsItemGroup;
-    m_scene->addItem(m_editBezierGroup);
+    m_motionPlayheadItem = new QGraphicsPathItem;
+    m_motionPlayheadItem->setPen(QPen(Qt::magenta, 2));
+    m_scene->addItem(m_motionPlayheadItem);
+    m_editHandleItem = new BezierHandleItem;
+    m_editHandleItem->setZValue(1000);  // above the layers
+    m_editHandleItem->setVisible(false);
+    m_scene->addItem(m_editHandleItem);
+    m_layerCompositeItem = new LayerCompositeItem;
+    m_layerCompositeItem->setZValue(-0.5);  // where the layer groups are
+    m_layerCompositeItem->setVisible(false);
+    m_scene->addItem(m_layerCompositeItem);
+    m_onionSkinItem = new QGraphicsPixmapItem;
+    m_onionSkinItem->setZValue(-1);  // under the layers
+    m_onionSkinItem->setTransformationMode(Qt::SmoothTransformation);
+    m_onionSkinItem->setVisible(false);
+    m_scene->addItem(m_onionSkinItem);
+    m_onionSkinCache.setUpdateFunction([this](const QString& uuid) {
+        for (const OnionSkinPanel& panel : m_onionSkinPanels) {
+            if (panel.uuid == uuid) {
+                updateOnionSkinItem();
+                return;
+            }
+        }
+    });
     // Initialize first layer
     GameFusion::Layer baseLayer;
     //baseLayer.uuid = QUuid::createUuid().toString(QUuid::WithoutBraces);
@@ -115,8 +157,11 @@ PaintCanvas::PaintCanvas(QWidget *parent) :
 
 
     LayerGroupItem *baseGroup = new LayerGroupItem;
+    baseGroup->setUseRasterizedImage(true);
+    baseGroup->setRasterProgressFunction([this](int) { invalidatePip(); viewport()->update(); });
     baseGroup->setZValue(layersUI.size() - 1);
     m_layerItems.append(baseGroup);
+    m_strokeIndices.append(GameFusion::StrokeSpatialIndex());
     m_scene->addItem(baseGroup);
     baseLayerUI.layerGroup = baseGroup;
 
@@ -161,23 +206,29 @@ PaintCanvas::PaintCanvas(QWidget *parent) :
     resize(m_baseSize);
     updateCompositeImage();
 
+    // Stroke fitting threads are started here, not at pen-down
+    m_strokeService = new StrokeWorkerService(this);
+    connect(m_strokeService, &StrokeWorkerService::firstCurveLatency, this, [](double milliseconds) {
+        if (m_verbose)
+            GameFusion::Log().print() << "Pen-down to first curve " << milliseconds << " ms\n";
+    });
+    currentStrokePoints.reserve(kStrokePointReserve);  // clear() keeps it for the next stroke
+
+    // Wet ink of the stroke being drawn; input stays with the canvas, which
+    // feeds the overlay its samples
     m_drawingOverlay = new DrawingOverlay(viewport());  // Parent to viewport
-    m_drawingOverlay->setGeometry(viewport()->geometry());  // Match size
+    m_drawingOverlay->setGeometry(viewport()->rect());  // Match size, viewport coordinates
+    m_drawingOverlay->setAttribute(Qt::WA_TransparentForMouseEvents);
+    m_drawingOverlay->setStrokeProperties(strokeProperties);
+    m_drawingOverlay->setStrokeService(m_strokeService);
     connect(m_drawingOverlay, &DrawingOverlay::strokeCompleted, this, &PaintCanvas::addStrokeToScene);
 }
 
 PaintCanvas::~PaintCanvas() {
-    for (QThread* thread : m_threads) {
-        thread->quit();
-        thread->wait();
-        delete thread; // Deletes worker as well
-    }
-    m_threads.clear();
+    // Stop the stroke threads before the canvas they report to goes away
+    delete m_strokeService;
+    m_strokeService = nullptr;
 
-    if (currentStrokeGroup) {
-        delete currentStrokeGroup;
-        currentStrokeGroup = nullptr;
-    }
 }
 
 void PaintCanvas::createReferenceBorder(){
@@ -272,13 +323,18 @@ void PaintCanvas::addNewLayer() {
     newLayerUI.rect = QRectF(0, 0, m_baseSize.width(), m_baseSize.height());
 
     LayerGroupItem *newGroup = new LayerGroupItem;
+    newGroup->setUseRasterizedImage(true);
+    newGroup->setRasterProgressFunction([this](int) { invalidatePip(); viewport()->update(); });
     newGroup->setZValue(layersUI.size() - 1);
     m_layerItems.append(newGroup);
+    m_strokeIndices.append(GameFusion::StrokeSpatialIndex());
     m_scene->addItem(newGroup);
     newLayerUI.layerGroup = newGroup;
 
     layersUI.append(newLayerUI);
     activeLayerIndex = layersUI.size() - 1;
+    updateEditBezierGroup();
+    invalidatePip();
 
     emit layerAdded(newLayerUI.layer);
     viewport()->update();  // No updateCompositeImage needed
@@ -286,31 +342,16 @@ void PaintCanvas::addNewLayer() {
 
 
 
-QRectF PaintCanvas::drawBezierCurve(LayerGroupItem* layerGroup, GameFusion::BezierCurve& curve)
+// Path, pen and brush of one stroke at layer resolution: the exact Bézier
+// path for uniform width, or the tessellated stroke envelope for variable
+// width. Only touches the curve's own caches, so copies of curves can be
+// turned into primitives on the thread pool. Returns false for an empty stroke.
+static bool strokePrimitive(const GameFusion::BezierCurve& curve, RasterPrimitive& primitive)
 {
-    // Ensure the curve is assessed to generate up-to-date vertices and align with pre-computed pressures
-    // This guarantees vertexArray() and strokePressure() are synchronized (no re-sampling mismatch)
     StrokeProperties curveProperties = curve.getStrokeProperties();
-    if(curve.vertexArray().empty())
-        curve.assess(curveProperties.stepCount, false);  // Generate vertices at stepCount resolution; false = not closed
-    // Initialize bounding rectangle from vertices (more accurate than path approximation)
-    QRectF boundingRect;
-    const std::vector<GameFusion::Vector3D>& vertexArray = curve.vertexArray();
-    if (!vertexArray.empty()) {
-        // Compute initial bbox from first vertex (zoomed)
-        const GameFusion::Vector3D& firstVert = vertexArray[0];
-        boundingRect = QRectF(firstVert.x(), firstVert.y(), 0, 0);
-        // Expand to include all vertices (zoomed)
-        for (const auto& vert : vertexArray) {
-            boundingRect = boundingRect.united(QRectF(
-                vert.x(), vert.y(), 1, 1
-                ));
-        }
-    }
-    // Early exit if no vertices
-    if (vertexArray.empty()) {
-        return boundingRect;
-    }
+    if (curve.size() < 1)
+        return false;
+
     // Determine if variable width is needed (based on mode)
     bool variableWidth = false;
     float uniformWidth = curveProperties.maxWidth;  // Default for uniform
@@ -329,8 +370,8 @@ QRectF PaintCanvas::drawBezierCurve(LayerGroupItem* layerGroup, GameFusion::Bezi
              Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
     pen.setBrush(Qt::NoBrush);  // Lines, no fill
     // Handle color/gradient (independent of width)
-    QPointF startPoint(vertexArray.front().x(), vertexArray.front().y());
-    QPointF endPoint(vertexArray.back().x(), vertexArray.back().y());
+    QPointF startPoint(curve[0].point.x(), curve[0].point.y());
+    QPointF endPoint(curve[curve.size() - 1].point.x(), curve[curve.size() - 1].point.y());
     QLinearGradient gradient(startPoint, endPoint);
     switch (curveProperties.colorMode) {
     case StrokeProperties::SolidForeground:
@@ -350,90 +391,56 @@ QRectF PaintCanvas::drawBezierCurve(LayerGroupItem* layerGroup, GameFusion::Bezi
         pen.setBrush(gradient);
         break;
     }
-    // Reference to pre-computed pressures (sized to match vertexArray)
-    const std::vector<float>& pressures = curve.strokePressure();
-    bool hasPressures = !pressures.empty() && pressures.size() == vertexArray.size();
-    // For uniform width: Draw the entire curve as a single path (smooth and efficient)
-
-    StrokeGroupItem *strokeGroup = new StrokeGroupItem;
 
     if (!variableWidth) {
-        // Build QPainterPath from control points (zoomed) for exact Bézier rendering
+        // Build QPainterPath from control points for exact Bézier rendering
         QPainterPath path;
-        if (curve.size() >= 1) {
-            const auto& firstHandle = curve[0];
-            path.moveTo(firstHandle.point.x(), firstHandle.point.y());
-            for (size_t i = 0; i < curve.size() - 1; ++i) {
-                const auto& current = curve[i];
-                const auto& next = curve[i + 1];
-                path.cubicTo(
-                    (current.point.x() + current.rightControl.x()),
-                    (current.point.y() + current.rightControl.y()),
-                    (next.point.x() + next.leftControl.x()),
-                    (next.point.y() + next.leftControl.y()),
-                    next.point.x(),
-                    next.point.y()
-                    );
-            }
-
-
-
-            // Apply uniform width and draw
-            pen.setWidthF(uniformWidth);
-            QGraphicsPathItem *pathItem = new QGraphicsPathItem(path);
-            pathItem->setPen(pen);  // Uniform pen for all
-            strokeGroup->addToGroup(pathItem);
-
-        }
-        //painter.setPen(pen);
-        //painter.drawPath(path);
-    } else {
-        // For variable width: Draw line segments between pre-computed vertices
-        // This exactly matches the computed pressures (no interpolation mismatch)
-        // Use averaged pressure per segment for smooth width transitions
-        for (size_t i = 1; i < vertexArray.size(); ++i) {
-            // Compute segment width
-            float currentWidth;
-            if (hasPressures && curveProperties.variableWidthMode == StrokeProperties::Pressure) {
-                // Use pre-computed pressures: Average between adjacent vertices for fluid joins
-                float p1 = pressures[i - 1];
-                float p2 = pressures[i];
-                float avgPressure = (p1 + p2) / 2.0f;
-                currentWidth = curveProperties.minWidth + (curveProperties.maxWidth - curveProperties.minWidth) * avgPressure;
-            } else {
-                // Fallback for TaperIn/Out: Linear interpolation based on global t
-                // (Compute uniform t from vertex index; matches assess() parameterization)
-                float global_t = static_cast<float>(i - 1) / static_cast<float>(vertexArray.size() - 1);
-                if (curveProperties.variableWidthMode == StrokeProperties::TaperIn) {
-                    currentWidth = curveProperties.minWidth + (curveProperties.maxWidth - curveProperties.minWidth) * global_t;
-                } else if (curveProperties.variableWidthMode == StrokeProperties::TaperOut) {
-                    currentWidth = curveProperties.maxWidth + (curveProperties.minWidth - curveProperties.maxWidth) * global_t;
-                } else {
-                    // Parabolic fallback if no pressures (Pressure mode without data)
-                    float tNorm = 2.0f * global_t - 1.0f;
-                    currentWidth = curveProperties.minWidth + (curveProperties.maxWidth - curveProperties.minWidth) * (1.0f - tNorm * tNorm);
-                }
-            }
-            // Update pen for this segment (zoom applied)
-            pen.setWidthF(currentWidth);
-            //painter.setPen(pen);
-            // Draw line between zoomed vertices
-            const GameFusion::Vector3D& v1 = vertexArray[i - 1];
-            const GameFusion::Vector3D& v2 = vertexArray[i];
-            /*
-            painter.drawLine(
-                QPointF(v1.x(), v1.y()),
-                QPointF(v2.x(), v2.y())
-                );
-            */
-            QGraphicsLineItem *line = new QGraphicsLineItem(
-                v1.x(), v1.y(),
-                v2.x(), v2.y()
+        const auto& firstHandle = curve[0];
+        path.moveTo(firstHandle.point.x(), firstHandle.point.y());
+        for (size_t i = 0; i < curve.size() - 1; ++i) {
+            const auto& current = curve[i];
+            const auto& next = curve[i + 1];
+            path.cubicTo(
+                (current.point.x() + current.rightControl.x()),
+                (current.point.y() + current.rightControl.y()),
+                (next.point.x() + next.leftControl.x()),
+                (next.point.y() + next.leftControl.y()),
+                next.point.x(),
+                next.point.y()
                 );
-            line->setPen(pen);
-            strokeGroup->addToGroup(line);
         }
+
+        // Apply uniform width
+        pen.setWidthF(uniformWidth);
+        primitive.path = path;
+        primitive.pen = pen;
+        primitive.brush = QBrush();
+    } else {
+        // For variable width: fill the stroke outline tessellated from the
+        // adaptive flattening and pressures (cached on the curve)
+        primitive.path = curve.strokeOutline(kCurveTolerance);
+        primitive.pen = QPen(Qt::NoPen);
+        primitive.brush = pen.brush();  // Solid color or gradient
     }
+    return true;
+}
+
+QRectF PaintCanvas::drawBezierCurve(LayerGroupItem* layerGroup, GameFusion::BezierCurve& curve)
+{
+    // Uniform strokes are drawn from the handles and variable ones from the
+    // outline, so neither needs the curve flattened here; the bounds are
+    // analytic and cached on the curve until it changes
+    StrokeProperties curveProperties = curve.getStrokeProperties();
+    const GameFusion::BBox& bounds = curve.bounds();
+    // Early exit if nothing to draw (an empty item keeps the group in stroke order)
+    if (bounds.minX > bounds.maxX) {
+        layerGroup->addStroke(new QGraphicsPathItem);
+        return QRectF();
+    }
+    QRectF boundingRect(bounds.minX, bounds.minY, bounds.maxX - bounds.minX, bounds.maxY - bounds.minY);
+
+    // One scene item per stroke
+    QGraphicsPathItem *strokeItem = createStrokeItem(curve);
     // Expand bounding rectangle to account for max stroke width (zoomed)
     boundingRect.adjust(
         -curveProperties.maxWidth,
@@ -442,25 +449,39 @@ QRectF PaintCanvas::drawBezierCurve(LayerGroupItem* layerGroup, GameFusion::Bezi
         curveProperties.maxWidth
         );
 
-    layerGroup->addToGroup(strokeGroup);
+    layerGroup->addStroke(strokeItem);
 
     //layerGroup->optimize();
-    layerGroup->setUseRasterizedImage(true);
 
     return boundingRect;
 }
 
+QGraphicsPathItem* PaintCanvas::createStrokeItem(GameFusion::BezierCurve& curve) {
+    QGraphicsPathItem *strokeItem = new QGraphicsPathItem;
+    RasterPrimitive primitive;
+    if (strokePrimitive(curve, primitive)) {
+        strokeItem->setPath(primitive.path);
+        strokeItem->setPen(primitive.pen);
+        strokeItem->setBrush(primitive.brush);
+    }
+    return strokeItem;
+}
+
 void PaintCanvas::computeLayerImage(LayerUI& layerUI) {
 
     LayerGroupItem* group = layerUI.layerGroup;
     if (!group) return;
 
-    // Clear existing children to rebuild
-    QList<QGraphicsItem*> children = group->childItems();
-    for (QGraphicsItem* child : children) {
-        group->removeFromGroup(child);
-        delete child;
-    }
+    // Clear existing children and the raster cache to rebuild
+    group->clearStrokes();
+
+    // Bound and outline the strokes on the thread pool first (each curve
+    // caches its own result); building the items below then only wraps them
+    QtConcurrent::blockingMap(layerUI.layer.strokes, [](GameFusion::BezierCurve& curve) {
+        curve.bounds();
+        if (curve.getStrokeProperties().variableWidthMode != StrokeProperties::Uniform)
+            curve.strokeOutline(kCurveTolerance);
+    });
 
     for (GameFusion::BezierCurve& curve : layerUI.layer.strokes) {
         QRectF curveBounds = drawBezierCurve(group, curve);
@@ -471,13 +492,172 @@ void PaintCanvas::computeLayerImage(LayerUI& layerUI) {
             layerUI.rect = layerUI.rect.united(curveBounds);        // extend bounding box
     }
 
+    strokeIndex(layerUI).build(layerUI.layer.strokes);
+
     layerUI.imageDirty = false;
 }
 
+// Append-only commit of a finished stroke: only the new stroke is tessellated and
+// painted into the layer's raster cache, so commit cost does not grow with the
+// layer. Edits and deletes still go through the full computeLayerImage rebuild.
+void PaintCanvas::commitStrokeToLayer(LayerUI& layerUI, GameFusion::BezierCurve& curve) {
+    LayerGroupItem* group = layerUI.layerGroup;
+    if (!group || layerUI.imageDirty) return;  // pending full rebuild picks it up
+
+    QRectF curveBounds = drawBezierCurve(group, curve);
+    strokeIndex(layerUI).insert(int(layerUI.layer.strokes.size()) - 1, curve);
+
+    if(layerUI.rect.isNull())
+        layerUI.rect = curveBounds;
+    else
+        layerUI.rect = layerUI.rect.united(curveBounds);
+    invalidatePip();
+}
+
+int PaintCanvas::pendingRasterTiles() const {
+    int pending = 0;
+    for (const LayerGroupItem* group : m_layerItems)
+        pending += group->tileCache().pendingTileCount();
+    return pending;
+}
+
+GameFusion::StrokeSpatialIndex& PaintCanvas::strokeIndex(const LayerUI& layerUI) {
+    return m_strokeIndices[m_layerItems.indexOf(layerUI.layerGroup)];
+}
+
+// Rubber band selection over the visible layers. The rect is mapped into each
+// layer's coordinates; rotated layers are queried with the mapped polygon.
+void PaintCanvas::selectStrokesInRect(const QRectF& sceneRect) {
+    using SelectedStroke = decltype(currentSelection.selectedStrokes)::value_type;
+
+    currentSelection.selectedStrokes.clear();
+    for (int i = 0; i < layersUI.size(); ++i) {
+        LayerUI& layerUI = layersUI[i];
+        if (!layerUI.layer.visible)
+            continue;
+
+        LayerGroupItem* group = m_layerItems[i];
+        QPolygonF area = group->mapFromScene(sceneRect.normalized());
+        std::vector<int> hits = group->transform().isRotating()
+                                    ? m_strokeIndices[i].queryPolygon(area)
+                                    : m_strokeIndices[i].queryRect(area.boundingRect());
+        for (int id : hits) {
+            SelectedStroke selected;
+            selected.stroke = &layerUI.layer.strokes[id];
+            selected.layerIndex = i;
+            currentSelection.selectedStrokes.push_back(selected);
+        }
+    }
+
+    hasSelection = !currentSelection.selectedStrokes.empty();
+    emit strokeSelected(currentSelection);
+}
+
+// Erase tool: cut away the parts of the active layer's strokes under the
+// eraser moved from the previous point of the drag. Strokes are split where
+// they enter and leave its footprint; the model, the spatial index and the
+// layer's items are updated in place and the edits kept for the undo record.
+void PaintCanvas::eraseStrokesAt(const QPoint& pos) {
+    if (activeLayerIndex < 0 || activeLayerIndex >= layersUI.size()) return;
+
+    LayerUI& layerUI = layersUI[activeLayerIndex];
+    LayerGroupItem* group = m_layerItems[activeLayerIndex];
+    GameFusion::StrokeSpatialIndex& index = m_strokeIndices[activeLayerIndex];
+
+    QPointF layerPos = group->mapFromScene(mapToScene(pos));
+    QPointF fromPos = eraserPath.empty() ? layerPos : eraserPath.back();
+    eraserPath.push_back(layerPos);
+    float radius = std::max(2.0f, float(strokeProperties.maxWidth) * 0.5f);
+
+    std::vector<GameFusion::StrokeErase> edits = GameFusion::StrokeEraser::erase(
+        layerUI.layer.strokes, index,
+        GameFusion::Vector3D(fromPos.x(), fromPos.y(), 0), GameFusion::Vector3D(layerPos.x(), layerPos.y(), 0),
+        radius);
+    if (edits.empty())
+        return;
+
+    // Edits come by increasing id with the earlier pieces already in place
+    for (const GameFusion::StrokeErase& edit : edits) {
+        QVector<QGraphicsPathItem*> pieces;
+        for (size_t k = 0; k < edit.pieces.size(); ++k)
+            pieces.append(createStrokeItem(layerUI.layer.strokes[edit.id + k]));
+        group->replaceStrokeAt(edit.id, pieces);
+    }
+    m_eraseEdits.insert(m_eraseEdits.end(),
+                        std::make_move_iterator(edits.begin()), std::make_move_iterator(edits.end()));
+
+    currentSelection.selectedStrokes.clear();
+    hasSelection = false;
+    invalidatePip();
+    viewport()->update();
+}
+
+
+void PaintCanvas::applyStrokeErase(const QString& layerUuid, const std::vector<GameFusion::StrokeErase>& edits, bool revert) {
+    auto it = std::find_if(layersUI.begin(), layersUI.end(),
+                           [&](const LayerUI& l) { return l.layer.uuid == layerUuid.toStdString(); });
+    if (it == layersUI.end()) return;
+    const int i = int(it - layersUI.begin());
+
+    std::vector<GameFusion::BezierCurve>& strokes = layersUI[i].layer.strokes;
+    LayerGroupItem* group = m_layerItems[i];
+    GameFusion::StrokeSpatialIndex& index = m_strokeIndices[i];
+
+    if (revert) {
+        // Last edit first, so each id is where its pieces are
+        for (auto e = edits.rbegin(); e != edits.rend(); ++e) {
+            const int n = static_cast<int>(e->pieces.size());
+            strokes.erase(strokes.begin() + e->id, strokes.begin() + e->id + n);
+            strokes.insert(strokes.begin() + e->id, e->original);
+            for (int k = n - 1; k > 0; --k) {
+                group->removeStrokeAt(e->id + k);
+                index.erase(e->id + k);
+            }
+            if (n > 0) {
+                group->replaceStrokeAt(e->id, {createStrokeItem(strokes[e->id])});
+                index.update(e->id, strokes[e->id]);
+            } else {
+                group->insertStrokeAt(e->id, createStrokeItem(strokes[e->id]));
+                index.insert(e->id, strokes[e->id]);
+            }
+        }
+    } else {
+        // Same order as the drag, the earlier pieces already in place
+        for (const GameFusion::StrokeErase& edit : edits) {
+            strokes.erase(strokes.begin() + edit.id);
+            strokes.insert(strokes.begin() + edit.id, edit.pieces.begin(), edit.pieces.end());
+            QVector<QGraphicsPathItem*> pieces;
+            index.erase(edit.id);
+            for (size_t k = 0; k < edit.pieces.size(); ++k) {
+                pieces.append(createStrokeItem(strokes[edit.id + k]));
+                index.insert(edit.id + int(k), strokes[edit.id + k]);
+            }
+            group->replaceStrokeAt(edit.id, pieces);
+        }
+    }
 
+    if (i == activeLayerIndex) {
+        currentSelection.selectedStrokes.clear();
+        hasSelection = false;
+    }
+    invalidatePip();
+    viewport()->update();
+}
 
 // Keep updateCompositeImage: Now rebuilds dirty groups + applies transforms/opacity
 void PaintCanvas::updateCompositeImage() {
+    invalidatePip();  // layer content, transforms or opacity may have changed
+    // Blurred layers also go through the composite item
+    QVector<QVector<QPointF>> blurOffsets(layersUI.size());
+    bool blurring = false;
+    for (int i = 0; i < layersUI.size(); ++i) {
+        if (layersUI[i].layer.visible) {
+            motionBlurOffsets(layersUI[i], blurOffsets[i]);
+            blurring |= !blurOffsets[i].isEmpty();
+        }
+    }
+    const bool compositing = blurring || needsLayerCompositor();
+    QVector<LayerCompositeItem::Source> sources;
     for (int i = 0; i < layersUI.size(); ++i) {
         LayerUI& layerUI = layersUI[i];
         if (layerUI.imageDirty) {
@@ -493,18 +673,197 @@ void PaintCanvas::updateCompositeImage() {
         float op = layerUI.layer.opacity;
         if (m_lightTableMode && i != activeLayerIndex) op *= 0.3f;
         group->setOpacity(op);
-        group->setVisible(layerUI.layer.visible);
+        // With blend modes in play the composite item draws the layers
+        group->setVisible(layerUI.layer.visible && !compositing);
+        if (compositing && layerUI.layer.visible)
+            sources.append({group, layerUI.layer.blendMode, op, blurOffsets[i]});
+    }
+    m_layerCompositeItem->setSources(sources);
+    m_layerCompositeItem->setVisible(compositing);
+}
+
+bool PaintCanvas::needsLayerCompositor() const {
+    for (const LayerUI& layerUI : layersUI) {
+        if (layerUI.layer.visible && layerUI.layer.blendMode != GameFusion::BlendMode::Opacity)
+            return true;
     }
+    return false;
+}
+
+// Export: the base frame drawn the way the viewport draws it, through the
+// composite item when blend modes are used, with every tile rastered first
+void PaintCanvas::renderFrameToImage(QImage &frameImage) {
+    if (frameImage.size() != m_baseSize || frameImage.format() != QImage::Format_ARGB32_Premultiplied)
+        frameImage = QImage(m_baseSize, QImage::Format_ARGB32_Premultiplied);
+    frameImage.fill(Qt::transparent);
+
+    const QRectF source(0, 0, m_baseSize.width(), m_baseSize.height());
+    for (LayerGroupItem* group : m_layerItems)
+        group->tileCache().rasterDirtyTiles(group->mapRectFromScene(source));
+
+    const bool wasExportMode = m_exportMode;
+    setExportMode(true);
+    QPainter p(&frameImage);
+    p.setRenderHints(QPainter::Antialiasing | QPainter::SmoothPixmapTransform);
+    m_scene->render(&p, QRectF(frameImage.rect()), source);
+    p.end();
+    setExportMode(wasExportMode);
+}
+
+void LayerCompositeItem::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget) {
+    Q_UNUSED(widget);
+    if (m_sources.isEmpty())
+        return;
+
+    // Composite in device pixels over the exposed area
+    const QTransform world = painter->worldTransform();
+    const qreal dpr = painter->device() ? painter->device()->devicePixelRatioF() : 1.0;
+    const QRect deviceRect = world.mapRect(option->exposedRect).toAlignedRect();
+    if (deviceRect.isEmpty())
+        return;
+    const QSize size(qCeil(deviceRect.width() * dpr), qCeil(deviceRect.height() * dpr));
+    if (m_target.size() != size)
+        m_target = QImage(size, QImage::Format_ARGB32_Premultiplied);
+    m_target.setDevicePixelRatio(1.0);
+    m_target.fill(Qt::transparent);
+
+    const QTransform sceneToTarget = world * QTransform::fromTranslate(-deviceRect.left(), -deviceRect.top())
+                                     * QTransform::fromScale(dpr, dpr);
+
+    QVector<LayerCompositor::Layer> layers;
+    m_layerImages.resize(m_sources.size());
+    m_blurImages.resize(m_sources.size());
+    for (int i = 0; i < m_sources.size(); ++i) {
+        const Source& source = m_sources[i];
+        LayerTileCache& cache = source.group->tileCache();
+        const QTransform layerToTarget = source.group->sceneTransform() * sceneToTarget;
+        const QRectF exposed = source.group->mapRectFromScene(option->exposedRect);
+
+        const bool pixelAligned = layerToTarget.type() <= QTransform::TxTranslate &&
+                                  std::abs(layerToTarget.dx() - std::round(layerToTarget.dx())) < 1e-3 &&
+                                  std::abs(layerToTarget.dy() - std::round(layerToTarget.dy())) < 1e-3;
+
+        if (!source.blurOffsets.isEmpty()) {
+            // Motion blur: the layer is resampled once around the exposed
+            // area, then its shifted copies are averaged, one per sub-frame
+            QVector<QPoint> offsets;
+            QRect reach;
+            for (const QPointF& offset : source.blurOffsets) {
+                const QPoint shift = (layerToTarget.map(offset) - layerToTarget.map(QPointF())).toPoint();
+                offsets.append(shift);
+                reach = reach.united(QRect(shift, QSize(1, 1)));
+            }
+            // Content that any sub-frame brings into the target
+            const QRect area = m_target.rect().adjusted(-reach.right(), -reach.bottom(), -reach.left(), -reach.top());
+            const QRect contentRect = layerToTarget.mapRect(QRectF(cache.bounds())).toAlignedRect().intersected(area);
+            const QRect blurRect = contentRect.adjusted(reach.left(), reach.top(), reach.right(), reach.bottom())
+                                       .intersected(m_target.rect());
+            if (contentRect.isEmpty() || blurRect.isEmpty())
+                continue;
+            QImage& image = m_layerImages[i];
+            if (image.size() != contentRect.size())
+                image = QImage(contentRect.size(), QImage::Format_ARGB32_Premultiplied);
+            image.fill(Qt::transparent);
+            QPainter layerPainter(&image);
+            layerPainter.setRenderHint(QPainter::SmoothPixmapTransform, true);
+            layerPainter.setTransform(layerToTarget * QTransform::fromTranslate(-contentRect.left(), -contentRect.top()));
+            cache.paint(&layerPainter, layerToTarget.inverted().mapRect(QRectF(contentRect)));
+            layerPainter.end();
+
+            // Offsets into the blur image, which starts at blurRect
+            const QPoint origin = contentRect.topLeft() - blurRect.topLeft();
+            for (QPoint& offset : offsets)
+                offset += origin;
+            QImage& blurred = m_blurImages[i];
+            if (blurred.size() != blurRect.size())
+                blurred = QImage(blurRect.size(), QImage::Format_ARGB32_Premultiplied);
+            LayerCompositor::accumulate(blurred, image, offsets);
+            layers.append({blurred, blurRect.topLeft(), source.mode, source.opacity});
+            continue;
+        }
+
+        if (pixelAligned) {
+            // 1:1 with the target: the cached tiles are blended as they are
+            const QPoint shift(qRound(layerToTarget.dx()), qRound(layerToTarget.dy()));
+            for (const LayerTileCache::TileImage& tile : cache.level0Tiles(exposed))
+                layers.append({tile.image, tile.pos + shift, source.mode, source.opacity});
+            continue;
+        }
+
+        // Zoomed or rotated: resample the layer's content under the exposed area
+        const QRect contentRect = layerToTarget.mapRect(QRectF(cache.bounds())).toAlignedRect().intersected(m_target.rect());
+        if (contentRect.isEmpty())
+            continue;
+        QImage& image = m_layerImages[i];
+        if (image.size() != contentRect.size())
+            image = QImage(contentRect.size(), QImage::Format_ARGB32_Premultiplied);
+        image.fill(Qt::transparent);
+        QPainter layerPainter(&image);
+        layerPainter.setRenderHint(QPainter::SmoothPixmapTransform, true);
+        layerPainter.setTransform(layerToTarget * QTransform::fromTranslate(-contentRect.left(), -contentRect.top()));
+        cache.paint(&layerPainter, exposed);
+        layerPainter.end();
+        layers.append({image, contentRect.topLeft(), source.mode, source.opacity});
+    }
+
+    LayerCompositor::composite(m_target, layers);
+
+    painter->save();
+    painter->resetTransform();
+    m_target.setDevicePixelRatio(dpr);
+    painter->drawImage(deviceRect.topLeft(), m_target);
+    painter->restore();
 }
 
 void PaintCanvas::resizeEvent(QResizeEvent *event) {
     QGraphicsView::resizeEvent(event);
     if (m_drawingOverlay) {
-        m_drawingOverlay->setGeometry(viewport()->geometry());
+        m_drawingOverlay->setGeometry(viewport()->rect());
     }
 }
 
 void PaintCanvas::paintEvent(QPaintEvent *event) {
+    QGraphicsView::paintEvent(event);
+    QPainter p(viewport());
+    showFps = false;
+    if (showFps) {
+        p.setPen(Qt::black);
+        p.drawText(10, 20, QString("FPS: %1").arg(currentFps));
+    }
+    // Layer tiles still rastering in the background
+    int pendingTiles = pendingRasterTiles();
+    if (pendingTiles > 0) {
+        p.setPen(Qt::darkGray);
+        p.drawText(10, height() - 10, QString("Rendering %1 tiles...").arg(pendingTiles));
+    }
+    if (showPip) {
+        const QImage &pipImg = currentPipImage();
+        const QSizeF pipSize = pipImg.size() / pipImg.devicePixelRatio();
+        p.drawImage(QPointF(width() - pipSize.width() - 50, height() - pipSize.height() - 50), pipImg);
+    }
+}
+
+void PaintCanvas::setPipDisplay(bool enabled) {
+    showPip = enabled;
+    viewport()->update();
+}
+
+void PaintCanvas::invalidatePip() {
+    m_pipDirty = true;
+}
+
+const QImage& PaintCanvas::currentPipImage() {
+    if (m_pipDirty || m_pipImage.isNull()) {
+        renderPip(m_pipImage);
+        m_pipDirty = false;
+    }
+    return m_pipImage;
+}
+
+// Camera view of the scene at PiP size. The scene is rendered straight into
+// the small image with the camera and the downscale folded into the painter
+// transform, so no full size intermediate is drawn.
+void PaintCanvas::renderPip(QImage &pipImg) {
     static CameraFrameUI defaultCamera = []() {
         CameraFrameUI cam;
         cam.rect = QRectF(0, 0, 1920, 1080);  // HD resolution
@@ -515,161 +874,372 @@ void PaintCanvas::paintEvent(QPaintEvent *event) {
         return cam;
     }();
 
-    QGraphicsView::paintEvent(event);
-    QPainter p(viewport());
-    showFps = false;
-    if (showFps) {
-        p.setPen(Qt::black);
-        p.drawText(10, 20, QString("FPS: %1").arg(currentFps));
-    }
-    if (showPip) {
-        //CameraFrameUI interpolatedCamera = getInterpolatedCamera(currentTime);
-        //CameraFrameUI &currentCamera = cameraFrames.isEmpty() ? defaultCamera : interpolatedCamera;
+    //CameraFrameUI interpolatedCamera = getInterpolatedCamera(currentTime);
+    //CameraFrameUI &currentCamera = cameraFrames.isEmpty() ? defaultCamera : interpolatedCamera;
+
+    CameraFrameUI &currentCamera = defaultCamera;
+
+    const qreal dpr = devicePixelRatioF();
+    const QSize pipSize(qRound(m_baseSize.width() / kPipDownscale * dpr), qRound(m_baseSize.height() / kPipDownscale * dpr));
+    if (pipImg.size() != pipSize)
+        pipImg = QImage(pipSize, QImage::Format_ARGB32_Premultiplied);
+    pipImg.setDevicePixelRatio(1.0);
+    pipImg.fill(Qt::transparent);
+    if (pipImg.isNull())
+        return;
+
+    QPainter pipP(&pipImg);
+    pipP.setRenderHints(QPainter::Antialiasing | QPainter::SmoothPixmapTransform);
+
+    QPointF center = currentCamera.rect.center();
+    qreal rotation = currentCamera.frame.rotation;
+    qreal camZoom = currentCamera.frame.zoom;
+    qreal fitScale = pipImg.width() / qreal(m_baseSize.width());
+
+    QTransform V;
+    double output_center_x = pipImg.width() / 2.0;
+    double output_center_y = pipImg.height() / 2.0;
+    V.translate(output_center_x, output_center_y);
+    V.scale(fitScale, fitScale);
+    V.rotate(rotation);
+    V.scale(camZoom, camZoom);
+    V.translate(-center.x(), -center.y());
+
+    pipP.setTransform(V);
+
+    // Source and target are the same rect: the mapping is all in V
+    QRectF source(0, 0, m_baseSize.width(), m_baseSize.height());
+    m_scene->render(&pipP, source, source);
+    pipP.end();
+
+    pipImg.setDevicePixelRatio(dpr);
+}
 
-        CameraFrameUI &currentCamera = defaultCamera;
+void PaintCanvas::setLightTableMode(bool enabled) {
+    m_lightTableMode = enabled;
+    updateCompositeImage();
+    viewport()->update();
+}
 
-        float pipWidth = m_baseSize.width() / 9.0;
-        float pipHeight = m_baseSize.height() / 9.0;
+// Strokes of a source layer rastered at size, the canvas scaled by scale.
+// Runs on the thread pool, once per source and version for all its instances.
+static QImage renderLayerSource(const LayerSourceStore::Content& content, const QSize& size, qreal scale)
+{
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    QPainter p(&image);
+    p.setRenderHint(QPainter::Antialiasing, true);
+    p.scale(scale, scale);
+    for (const GameFusion::BezierCurve& curve : content.strokes) {
+        RasterPrimitive primitive;
+        if (strokePrimitive(curve, primitive))
+            LayerTileCache::paintPrimitive(p, primitive);
+    }
+    return image;
+}
 
-        QRect pipRect(width() - pipWidth -50, height() - pipHeight - 50, pipWidth, pipHeight);
-        QImage pipImg(m_baseSize, QImage::Format_ARGB32_Premultiplied);
-        pipImg.fill(Qt::transparent);
-        QPainter pipP(&pipImg);
-        pipP.setRenderHints(QPainter::Antialiasing | QPainter::SmoothPixmapTransform);
+// Flattened composite of a panel's visible stroke layers. Each layer is its
+// source's shared raster, blended with the layer's own mode and opacity.
+static QImage renderPanelComposite(LayerSourceStore& store, const QVector<LayerSourceStore::Instance>& instances,
+                                   const QSize& size, qreal scale)
+{
+    QImage composite(size, QImage::Format_ARGB32_Premultiplied);
+    composite.fill(Qt::transparent);
 
-        QPointF center = currentCamera.rect.center();
-        qreal rotation = currentCamera.frame.rotation;
-        qreal camZoom = currentCamera.frame.zoom;
+    QVector<LayerCompositor::Layer> layers;
+    for (const LayerSourceStore::Instance& instance : instances) {
+        QImage image = store.raster(instance.content, size, scale, renderLayerSource);
+        layers.append({image, QPoint(), instance.blendMode, instance.opacity});
+    }
+    LayerCompositor::composite(composite, layers);
+    return composite;
+}
 
-        qreal fitScale = 1.0; // qMin(pipImg.width() / currentCamera.rect.width(), pipImg.height() / currentCamera.rect.height());
+void PaintCanvas::setOnionSkinEnabled(bool enabled) {
+    if (m_onionSkinEnabled == enabled)
+        return;
+    m_onionSkinEnabled = enabled;
+    if (!enabled)
+        m_onionSkinPanels.clear();  // set again by the next setOnionSkinPanels()
+    updateOnionSkinItem();
+}
 
-        QTransform V;
-        double output_center_x = pipImg.width() / 2.0;
-        double output_center_y = pipImg.height() / 2.0;
-        V.translate(output_center_x, output_center_y);
-        V.rotate(rotation);
-        V.scale(camZoom, camZoom);
-        V.translate(-center.x(), -center.y());
+void PaintCanvas::setOnionSkinSettings(const OnionSkinSettings& settings) {
+    if (!qFuzzyCompare(settings.scale, m_onionSkinSettings.scale))
+        m_onionSkinCache.clear();  // composites are rendered at the old size
+    m_onionSkinSettings = settings;
+    updateOnionSkinItem();
+}
 
-        pipP.setTransform(V);
+void PaintCanvas::setOnionSkinPanels(const std::vector<GameFusion::Panel>& panels, int activeIndex) {
+    m_onionSkinPanels.clear();
+    if (!m_onionSkinEnabled || activeIndex < 0 || activeIndex >= int(panels.size())) {
+        updateOnionSkinItem();
+        return;
+    }
 
-        QRectF target(0, 0, pipImg.width(), pipImg.height());
-       // QRectF source = V.inverted().mapRect(target);
-        QRectF source(0, 0, m_baseSize.width(), m_baseSize.height());
+    const qreal scale = m_onionSkinSettings.scale;
+    const QSize size = (QSizeF(m_baseSize) * scale).toSize();
+    const int depth = std::max(0, m_onionSkinSettings.depth);
+    // Sources edited on the active panel are taken in first, so instances of
+    // them in the neighbours show the edit
+    m_layerSources->instances(panels[activeIndex]);
+    // One more panel on each side is rendered ahead, so the next step finds
+    // its composites ready
+    for (int distance = 1; distance <= depth + 1; ++distance) {
+        for (int side : {-1, 1}) {
+            const int index = activeIndex + side * distance;
+            if (index < 0 || index >= int(panels.size()))
+                continue;
+            const GameFusion::Panel& panel = panels[index];
+            const QString uuid = QString::fromStdString(panel.uuid);
+            // Instances share their source's strokes, so this neither copies
+            // nor hashes them
+            const QVector<LayerSourceStore::Instance> instances = m_layerSources->instances(panel);
+            const quint64 version = LayerSourceStore::compositeVersion(instances);
+            if (m_onionSkinCache.needs(uuid, version)) {
+                m_onionSkinCache.request(uuid, version, [store = m_layerSources, instances, size, scale]() {
+                    return renderPanelComposite(*store, instances, size, scale);
+                });
+            }
+            if (distance <= depth)
+                m_onionSkinPanels.append({uuid, distance, side < 0});
+        }
+    }
+    updateOnionSkinItem();
+}
 
-        m_scene->render(&pipP, source, target);
+void PaintCanvas::clearLayerSources() {
+    m_layerSources->clear();
+    m_onionSkinCache.clear();
+    m_onionSkinPanels.clear();
+    updateOnionSkinItem();
+}
 
-        QImage imgScalled = pipImg.scaled(pipRect.width(), pipRect.height());
-        p.drawImage(pipRect.topLeft(), imgScalled);
+void PaintCanvas::updateOnionSkinItem() {
+    const QSize size = (QSizeF(m_baseSize) * m_onionSkinSettings.scale).toSize();
+    QImage onionSkin;
+    if (m_onionSkinEnabled && !size.isEmpty()) {
+        onionSkin = QImage(size, QImage::Format_ARGB32_Premultiplied);
+        onionSkin.fill(Qt::transparent);
+        QPainter p(&onionSkin);
+        // Furthest first, so the nearest panels end up on top
+        bool drawn = false;
+        for (int i = m_onionSkinPanels.size() - 1; i >= 0; --i) {
+            const OnionSkinPanel& panel = m_onionSkinPanels[i];
+            QImage tinted = m_onionSkinCache.composite(panel.uuid);
+            if (tinted.size() != size)
+                continue;  // not rendered yet
+            {
+                QPainter tp(&tinted);
+                tp.setCompositionMode(QPainter::CompositionMode_SourceIn);
+                tp.fillRect(tinted.rect(), panel.previous ? m_onionSkinSettings.previousTint
+                                                          : m_onionSkinSettings.nextTint);
+            }
+            p.setOpacity(m_onionSkinSettings.opacity *
+                         std::pow(m_onionSkinSettings.falloff, panel.distance - 1));
+            p.drawImage(0, 0, tinted);
+            drawn = true;
+        }
+        p.end();
+        if (!drawn)
+            onionSkin = QImage();
     }
-}
 
-void PaintCanvas::setLightTableMode(bool enabled) {
-    m_lightTableMode = enabled;
-    updateCompositeImage();
+    if (onionSkin.isNull()) {
+        m_onionSkinItem->setPixmap(QPixmap());
+        m_onionSkinItem->setVisible(false);
+    } else {
+        m_onionSkinItem->setPixmap(QPixmap::fromImage(onionSkin));
+        m_onionSkinItem->setScale(1.0 / m_onionSkinSettings.scale);
+        m_onionSkinItem->setVisible(!m_exportMode);
+    }
+    invalidatePip();
     viewport()->update();
 }
 
 // Implement other methods similarly, adapting to scene items where necessary.
 void PaintCanvas::updateMotionPaths() {
-    motionHandleContext.clear();
-    // Clear existing motion path items and handles
-    for (QGraphicsPathItem *pathItem : m_layerMotionPathItems) {
-        m_scene->removeItem(pathItem);
-        delete pathItem;
-    }
-    m_layerMotionPathItems.clear();
-    for (QGraphicsItemGroup *group : m_layerMotionHandleGroups) {
-        m_scene->removeItem(group);
-        delete group;
+    const bool visible = motionOverlaysVisible();
+    setMotionOverlayItemsVisible(visible);
+    if (!visible)
+        return;  // resynced when shown again
+
+    // Called on every time change: the items are only touched when the
+    // keyframes or camera frames they show have changed
+    buildMotionOverlayKey(m_motionOverlayScratch);
+    if (!m_motionOverlayValid || m_motionOverlayScratch != m_motionOverlayKey) {
+        m_motionOverlayKey.swap(m_motionOverlayScratch);
+        m_motionOverlayValid = true;
+        motionHandleContext.clear();
+        invalidatePip();  // keyframes or camera frames moved
+        syncLayerMotionItems();
+        syncCameraFrameItems();
     }
-    m_layerMotionHandleGroups.clear();
-    // Layers motion paths
-    for (const auto& layerUI : layersUI) {
-        const GameFusion::Layer& layer = layerUI.layer;
-        QString uuid = QString::fromStdString(layer.uuid);
-        QPainterPath path;
-        if (!layer.motionKeyframes.empty()) {
-            auto kf = layer.motionKeyframes[0];
-            path.moveTo(kf.x, kf.y);
-            for (size_t i = 1; i < layer.motionKeyframes.size(); ++i) {
-                kf = layer.motionKeyframes[i];
-                path.lineTo(kf.x, kf.y);
-            }
+    updateMotionPlayhead();
+}
+
+void PaintCanvas::invalidateMotionPaths() {
+    m_motionOverlayValid = false;
+    updateMotionPaths();
+}
+
+void PaintCanvas::setExportMode(bool enabled) {
+    m_exportMode = enabled;
+    m_onionSkinItem->setVisible(m_onionSkinEnabled && !m_exportMode && !m_onionSkinItem->pixmap().isNull());
+    updateMotionPaths();
+}
+
+void PaintCanvas::setMotionPathDisplay(bool enabled) {
+    showMotionPaths = enabled;
+    updateMotionPaths();
+    viewport()->update();
+}
+
+void PaintCanvas::setMotionOverlayItemsVisible(bool visible) {
+    for (QGraphicsPathItem *pathItem : m_layerMotionPathItems)
+        pathItem->setVisible(visible);
+    for (QGraphicsPathItem *handleItem : m_layerMotionHandleItems)
+        handleItem->setVisible(visible);
+    for (QGraphicsRectItem *frameItem : m_cameraFrameItems)
+        frameItem->setVisible(visible);
+    for (QGraphicsItemGroup *group : m_cameraHandleGroups)
+        group->setVisible(visible);
+    m_cameraMotionPathItem->setVisible(visible);
+    m_motionPlayheadItem->setVisible(visible);
+}
+
+void PaintCanvas::buildMotionOverlayKey(std::vector<double>& key) const {
+    // Everything the overlay items are built from, in a fixed order; the zoom
+    // is in it for the path flattening and the handle context positions
+    key.clear();
+    key.push_back(m_zoomFactor);
+    key.push_back(layersUI.size());
+    for (const LayerUI& layerUI : layersUI) {
+        const auto& keyframes = layerUI.layer.motionKeyframes;
+        key.push_back(keyframes.size());
+        for (const auto& kf : keyframes) {
+            key.push_back(kf.x);
+            key.push_back(kf.y);
         }
-        QGraphicsPathItem *pathItem = new QGraphicsPathItem(path);
+    }
+    key.push_back(cameraFrames.size());
+    for (const CameraFrameUI *camera : cameraFrames) {
+        key.push_back(camera->rect.x());
+        key.push_back(camera->rect.y());
+        key.push_back(camera->rect.width());
+        key.push_back(camera->rect.height());
+        key.push_back(camera->frame.rotation);
+        key.push_back(camera->frame.zoom);
+    }
+}
+
+void PaintCanvas::syncLayerMotionItems() {
+    // One dashed path and one handle item per layer, kept across updates
+    while (m_layerMotionPathItems.size() < layersUI.size()) {
+        QGraphicsPathItem *pathItem = new QGraphicsPathItem;
         pathItem->setPen(QPen(Qt::magenta, 1, Qt::DashLine));
-        pathItem->setVisible(!m_exportMode);
         m_scene->addItem(pathItem);
         m_layerMotionPathItems.append(pathItem);
+        QGraphicsPathItem *handleItem = new QGraphicsPathItem;
+        handleItem->setBrush(Qt::yellow);
+        m_scene->addItem(handleItem);
+        m_layerMotionHandleItems.append(handleItem);
+    }
+    while (m_layerMotionPathItems.size() > layersUI.size()) {
+        delete m_layerMotionPathItems.takeLast();
+        delete m_layerMotionHandleItems.takeLast();
+    }
+
+    for (int l = 0; l < layersUI.size(); ++l) {
+        const GameFusion::Layer& layer = layersUI[l].layer;
+        QString uuid = QString::fromStdString(layer.uuid);
+        QPainterPath path;
+        QPainterPath handles;
         for (int i = 0; i < layer.motionKeyframes.size(); ++i) {
             double x = layer.motionKeyframes[i].x;
             double y = layer.motionKeyframes[i].y;
-            QPointF scenePos(x, y);
-            QPointF screenPos = sceneToScreen(x, y);
-            motionHandleContext.push_back({uuid, i, screenPos, false});
-            QGraphicsItemGroup *group = new QGraphicsItemGroup;
-            QGraphicsEllipseItem *handle = new QGraphicsEllipseItem(-5, -5, 10, 10);
-            handle->setPos(screenPos);
-            handle->setBrush(Qt::yellow);
-            group->addToGroup(handle);
-            m_scene->addItem(group);
-            m_layerMotionHandleGroups.append(group);
+            if (i == 0)
+                path.moveTo(x, y);
+            else
+                path.lineTo(x, y);
+            handles.addEllipse(QPointF(x, y), 5, 5);
+            motionHandleContext.push_back({uuid, i, sceneToScreen(x, y), false});
         }
+        m_layerMotionPathItems[l]->setPath(path);
+        m_layerMotionHandleItems[l]->setPath(handles);
     }
-    // Cameras motion path
-    m_cameraMotionPathItem->setPath(QPainterPath());
-    for (QGraphicsRectItem *frameItem : m_cameraFrameItems) {
-        m_scene->removeItem(frameItem);
-        delete frameItem;
+}
+
+void PaintCanvas::syncCameraFrameItems() {
+    // Frame rect and handle group per camera, reused and moved in place
+    while (m_cameraFrameItems.size() < cameraFrames.size()) {
+        QGraphicsRectItem *frameItem = new QGraphicsRectItem;
+        frameItem->setPen(QPen(Qt::green));
+        m_scene->addItem(frameItem);
+        m_cameraFrameItems.append(frameItem);
+        QGraphicsItemGroup *group = new QGraphicsItemGroup;
+        m_scene->addItem(group);
+        m_cameraHandleGroups.append(group);
     }
-    m_cameraFrameItems.clear();
-    for (QGraphicsItemGroup *group : m_cameraHandleGroups) {
-        m_scene->removeItem(group);
-        delete group;
+    while (m_cameraFrameItems.size() > cameraFrames.size()) {
+        delete m_cameraFrameItems.takeLast();
+        delete m_cameraHandleGroups.takeLast();
     }
-    m_cameraHandleGroups.clear();
+
     cameraMotionPathCurve.clear();
-    std::vector<GameFusion::StrokePoint> cameraPoints;
-    QPainterPath camPath;
-    if (!cameraFrames.isEmpty()) {
-        QPointF first = cameraFrames[0]->rect.center();
-        camPath.moveTo(first.x(), first.y());
-    }
-    for (size_t i = 0; i < cameraFrames.size(); ++i) {
+    for (int i = 0; i < cameraFrames.size(); ++i) {
         double x = cameraFrames[i]->rect.center().x();
         double y = cameraFrames[i]->rect.center().y();
-        QPointF screenPos = sceneToScreen(x, y);
         QString camUuid = QString::fromStdString(cameraFrames[i]->frame.uuid);
-        motionHandleContext.push_back({camUuid, (int)i, screenPos, true});
-        cameraPoints.push_back({QPointF(x, y), 1.0f});
-        cameraMotionPathCurve += GameFusion::BezierControl({(float)x, (float)y, 0}, {0,0, 0}, {0,0, 0}, i);
-        camPath.lineTo(screenPos);
-        QRectF scaledRect = QRectF(
-            cameraFrames[i]->rect.x(),
-            cameraFrames[i]->rect.y(),
-            cameraFrames[i]->rect.width(),
-            cameraFrames[i]->rect.height()
-            );
-        QGraphicsRectItem *frameItem = new QGraphicsRectItem(scaledRect); // scale rect?
-        frameItem->setTransform(cameraFrames[i]->getTransform(1));
-        frameItem->setPen(QPen(Qt::green));
-        m_scene->addItem(frameItem);
-        m_cameraFrameItems.append(frameItem);
-        QGraphicsItemGroup *group = new QGraphicsItemGroup;
-        // add handles
+        motionHandleContext.push_back({camUuid, i, sceneToScreen(x, y), true});
+        cameraMotionPathCurve += GameFusion::BezierControl({(float)x, (float)y, 0}, {0,0, 0}, {0,0, 0});
+
+        m_cameraFrameItems[i]->setRect(cameraFrames[i]->rect);
+        m_cameraFrameItems[i]->setTransform(cameraFrames[i]->getTransform(1));
+
+        QGraphicsItemGroup *group = m_cameraHandleGroups[i];
         QVector<QPointF> handles = cameraFrames[i]->getHandlePositions();
-        for (QPointF h : handles) {
+        QList<QGraphicsItem*> children = group->childItems();
+        while (children.size() < handles.size()) {
             QGraphicsEllipseItem *handleItem = new QGraphicsEllipseItem(-5, -5, 10, 10);
-            handleItem->setPos(h);
             group->addToGroup(handleItem);
+            children.append(handleItem);
         }
-        m_scene->addItem(group);
-        m_cameraHandleGroups.append(group);
+        while (children.size() > handles.size()) {
+            QGraphicsItem *handleItem = children.takeLast();
+            group->removeFromGroup(handleItem);
+            delete handleItem;
+        }
+        for (int j = 0; j < handles.size(); ++j)
+            children[j]->setPos(handles[j]);
+    }
+
+    // Path item is drawn live by the view: flatten for the current zoom
+    QPainterPath camPath;
+    const GameFusion::CurveFlattening& camFlattening =
+        cameraMotionPathCurve.flatten(kCurveTolerance / std::max(float(m_zoomFactor), 1e-3f));
+    for (size_t i = 0; i < camFlattening.vertices.size(); ++i) {
+        const GameFusion::Vector3D& v = camFlattening.vertices[i];
+        if (i == 0)
+            camPath.moveTo(v.x(), v.y());
+        else
+            camPath.lineTo(v.x(), v.y());
     }
-    cameraMotionPathCurve.assess(20, false);
     m_cameraMotionPathItem->setPath(camPath);
-    m_cameraMotionPathItem->setVisible(!m_exportMode);
+}
+
+void PaintCanvas::updateMotionPlayhead() {
+    if (!motionOverlaysVisible())
+        return;
+    // Where each animated layer is at currentTime
+    QPainterPath marks;
+    for (const LayerUI& layerUI : layersUI) {
+        if (layerUI.layer.motionKeyframes.empty())
+            continue;
+        marks.addEllipse(QPointF(layerUI.layer.x, layerUI.layer.y), 8, 8);
+    }
+    m_motionPlayheadItem->setPath(marks);
 }
 
 QPointF PaintCanvas::sceneToScreen(double x, double y) {
@@ -756,77 +1326,66 @@ void PaintCanvas::setToolMode(ToolMode mode) {
         break;
     case ToolMode::Edit:
         setDragMode(QGraphicsView::NoDrag);
-        updateEditBezierGroup();
         break;
     }
+    updateEditBezierGroup();  // shown in Edit mode only
     emit toolModeChanged(mode);
     viewport()->update();
 }
 
-void PaintCanvas::updateTempStrokeItem() {
-    if (m_tempStrokeItem) {
-        m_scene->removeItem(m_tempStrokeItem);
-        delete m_tempStrokeItem;
-        m_tempStrokeItem = nullptr;
+void PaintCanvas::setTempStrokePath(QGraphicsPathItem* item, const GameFusion::BezierCurve& curve) const {
+    if (curve.size() < 2) {
+        item->setPath(QPainterPath());
+        return;
     }
-    if (computeResult.curve.empty()) return;
-    StrokeProperties props = computeResult.curve.getStrokeProperties();
-    bool variableWidth = props.variableWidthMode != StrokeProperties::Uniform;
-    if (!variableWidth) {
+    const StrokeProperties& props = curve.getStrokeProperties();
+    if (props.variableWidthMode == StrokeProperties::Uniform) {
         QPainterPath path;
-        // build path similar to drawBezierCurve, with * m_zoomFactor
-        const auto& curve = computeResult.curve;
-        if (curve.size() >= 1) {
-            const auto& first = curve[0];
-            path.moveTo(first.point.x(), first.point.y());
-            for (size_t i = 0; i < curve.size() - 1; ++i) {
-                const auto& curr = curve[i];
-                const auto& next = curve[i + 1];
-                path.cubicTo(
-                    (curr.point.x() + curr.rightControl.x()),
-                    (curr.point.y() + curr.rightControl.y()),
-                    (next.point.x() + next.leftControl.x()),
-                    (next.point.y() + next.leftControl.y()),
-                    next.point.x(),
-                    next.point.y()
-                    );
-            }
-        }
-        QGraphicsPathItem *pathItem = new QGraphicsPathItem(path);
-        QPen pen(props.foregroundColor, props.maxWidth, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
-        pathItem->setPen(pen);
-        m_scene->addItem(pathItem);
-        m_tempStrokeItem = pathItem;
-    } else {
-        QGraphicsItemGroup *group = new QGraphicsItemGroup;
-        const auto& verts = computeResult.curve.vertexArray();
-        const auto& pressures = computeResult.curve.strokePressure();
-        for (size_t i = 1; i < verts.size(); ++i) {
-            float width = props.maxWidth; // compute as in drawBezierCurve
-            if (props.variableWidthMode == StrokeProperties::Pressure && pressures.size() == verts.size()) {
-                float avgP = (pressures[i-1] + pressures[i]) / 2.0f;
-                width = (props.minWidth + (props.maxWidth - props.minWidth) * avgP) * m_zoomFactor;
-            } // or taper etc.
-            QPen pen(props.foregroundColor, width, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
-            QGraphicsLineItem *line = new QGraphicsLineItem(
-                verts[i-1].x(), verts[i-1].y(),
-                verts[i].x(), verts[i].y()
+        path.moveTo(curve[0].point.x(), curve[0].point.y());
+        for (int i = 0; i + 1 < curve.size(); ++i) {
+            const auto& curr = curve[i];
+            const auto& next = curve[i + 1];
+            path.cubicTo(
+                (curr.point.x() + curr.rightControl.x()),
+                (curr.point.y() + curr.rightControl.y()),
+                (next.point.x() + next.leftControl.x()),
+                (next.point.y() + next.leftControl.y()),
+                next.point.x(),
+                next.point.y()
                 );
-            line->setPen(pen);
-            group->addToGroup(line);
         }
-        m_scene->addItem(group);
-        m_tempStrokeItem = group;
+        item->setPath(path);
+        item->setPen(QPen(props.foregroundColor, props.maxWidth, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
+        item->setBrush(Qt::NoBrush);
+    } else {
+        // Drawn live by the view: flatten for the current zoom
+        float tolerance = kCurveTolerance / std::max(float(m_zoomFactor), 1e-3f);
+        item->setPath(curve.strokeOutline(tolerance));
+        item->setPen(Qt::NoPen);
+        item->setBrush(props.foregroundColor);
     }
 }
 
-void PaintCanvas::handleResult(const WorkerResults &workerResults, bool completedFinal) {
-    computeResult = workerResults;
+void PaintCanvas::updateTempStrokeItem(const StrokeWorkerService::StrokeFit& fit) {
+    // Newly finalized segments are added once, as a piece of their own, and
+    // only the open segment is redrawn, so a preview costs the same however
+    // long the stroke already is
+    if (!m_tempStrokeItem) {
+        m_tempStrokeItem = new QGraphicsItemGroup;
+        m_scene->addItem(m_tempStrokeItem);
+        m_tempOpenItem = new QGraphicsPathItem(m_tempStrokeItem);
+    }
+    if (fit.finalized.size() >= 2)
+        setTempStrokePath(new QGraphicsPathItem(m_tempStrokeItem), fit.finalized);
+    setTempStrokePath(m_tempOpenItem, fit.open);
+}
+
+void PaintCanvas::handleResult(const StrokeWorkerService::StrokeFit &fit, bool completedFinal) {
     if (completedFinal) {
         //computeResult.curve.assess(strokeProperties.stepCount, false);
         GameFusion::Layer* currentLayer = &layersUI[activeLayerIndex].layer;
-        currentLayer->strokes.push_back(workerResults.curve);
-        layersUI[activeLayerIndex].imageDirty = true;
+        currentLayer->strokes.push_back(fit.finalized);
+        commitStrokeToLayer(layersUI[activeLayerIndex], currentLayer->strokes.back());
 
         layersUI[activeLayerIndex].layerGroup->show();
 
@@ -835,10 +1394,11 @@ void PaintCanvas::handleResult(const WorkerResults &workerResults, bool complete
             m_scene->removeItem(m_tempStrokeItem);
             delete m_tempStrokeItem;
             m_tempStrokeItem = nullptr;
+            m_tempOpenItem = nullptr;
         }
 
-        computeResult = WorkerResults(); // clear
         currentStrokePoints.clear();
+        m_drawingOverlay->clearInk();
 
         updateCompositeImage();
         emit layerModified(layersUI[activeLayerIndex].layer);
@@ -848,62 +1408,32 @@ void PaintCanvas::handleResult(const WorkerResults &workerResults, bool complete
 
     } else {
 
-        // Prune lines with pointIndex <= workerResults.pointIndex
-        if (currentStrokeGroup) {
-            QList<QGraphicsItem*> children = currentStrokeGroup->childItems();
-            for (QGraphicsItem* child : children) {
-                IndexedLineItem* line = dynamic_cast<IndexedLineItem*>(child);
-                if (line && line->pointIndex <= workerResults.pointIndex) {
-                    currentStrokeGroup->removeFromGroup(child);
-                    delete child;
-                }
-                else
-                    break;
-            }
-        }
+        // The fitted curve takes over the ink up to pointIndex
+        m_drawingOverlay->trimInk(fit.pointIndex);
 
-        updateTempStrokeItem();
+        updateTempStrokeItem(fit);
     }
     viewport()->update(); // Trigger repaint
 }
 
 // Implement other slots and methods similarly.
 void PaintCanvas::updateEditBezierGroup() {
-    // Clear group
-    QList<QGraphicsItem*> children = m_editBezierGroup->childItems();
-    for (QGraphicsItem *item : children) {
-        m_editBezierGroup->removeFromGroup(item);
-        delete item;
-    }
-    if (currentTool != ToolMode::Edit || activeLayerIndex < 0) return;
-    LayerUI &layer = layersUI[activeLayerIndex];
-    for (GameFusion::BezierCurve &curve : layer.layer.strokes) {
-        // Add lines for controls, ellipses for points and controls
-        for (size_t i = 0; i < curve.size(); ++i) {
-            const auto& control = curve[i];
-            QPointF p(control.point.x() * m_zoomFactor, control.point.y() * m_zoomFactor);
-            QPointF left(control.point.x() + control.leftControl.x() * m_zoomFactor, control.point.y() + control.leftControl.y() * m_zoomFactor);
-            QPointF right(control.point.x() + control.rightControl.x() * m_zoomFactor, control.point.y() + control.rightControl.y() * m_zoomFactor);
-            QGraphicsLineItem *leftLine = new QGraphicsLineItem(p.x(), p.y(), left.x(), left.y());
-            leftLine->setPen(QPen(Qt::blue, 1));
-            m_editBezierGroup->addToGroup(leftLine);
-            QGraphicsLineItem *rightLine = new QGraphicsLineItem(p.x(), p.y(), right.x(), right.y());
-            rightLine->setPen(QPen(Qt::blue, 1));
-            m_editBezierGroup->addToGroup(rightLine);
-            QGraphicsEllipseItem *pointHandle = new QGraphicsEllipseItem(-3, -3, 6, 6);
-            pointHandle->setPos(p);
-            pointHandle->setBrush(Qt::red);
-            m_editBezierGroup->addToGroup(pointHandle);
-            QGraphicsEllipseItem *leftHandle = new QGraphicsEllipseItem(-3, -3, 6, 6);
-            leftHandle->setPos(left);
-            leftHandle->setBrush(Qt::green);
-            m_editBezierGroup->addToGroup(leftHandle);
-            QGraphicsEllipseItem *rightHandle = new QGraphicsEllipseItem(-3, -3, 6, 6);
-            rightHandle->setPos(right);
-            rightHandle->setBrush(Qt::green);
-            m_editBezierGroup->addToGroup(rightHandle);
-        }
+    // One item draws every handle of the active layer from a copy of the
+    // control points; entering Edit mode no longer creates scene items
+    m_editHandleHit = BezierHandleItem::Hit();
+    if (currentTool != ToolMode::Edit || activeLayerIndex < 0) {
+        m_editHandleItem->clear();
+        m_editHandleItem->setVisible(false);
+        return;
     }
+    m_editHandleItem->setCurves(layersUI[activeLayerIndex].layer.strokes);
+    m_editHandleItem->setVisible(true);
+}
+
+BezierHandleItem::Hit PaintCanvas::editHandleAt(const QPoint& pos) const {
+    // Hit radius is constant on screen
+    const qreal viewScale = std::sqrt(std::abs(transform().determinant()));
+    return m_editHandleItem->hitTest(mapToScene(pos), kEditHandleHitRadius / std::max(viewScale, 1e-6));
 }
 
 void PaintCanvas::setCurrentTime(const double currentTime) {
@@ -916,41 +1446,31 @@ void PaintCanvas::setCurrentTime(const double currentTime) {
         layersUI[i].layer.scale = vals.scale;
         layersUI[i].layer.rotation = vals.rotation;
         layersUI[i].layer.opacity = vals.opacity;
-        if (layersUI[i].enableMotionBlur) {
-            layersUI[i].imageDirty = true;
-        }
     }
+    // Motion blur is applied when compositing, from the layer's cached raster
     updateCompositeImage();
-    // Update motion paths if necessary
+    // Moves the playhead; the paths are only rebuilt if keyframes changed
     updateMotionPaths();
     viewport()->update();
 }
 
 void PaintCanvas::createThreadWorker() {
 
-    // Create new thread and worker for the stroke
-    QThread* thread = new QThread(this);
-    QString layerUuid = QUuid::createUuid().toString();
-    Worker* worker = new Worker(layerUuid, activeLayerIndex, 0, strokeProperties, 0);
-    worker->moveToThread(thread);
-    m_threads.append(thread);
-    m_currentWorker = worker;
-
-    connect(this, &PaintCanvas::newPointAvailable, worker, &Worker::addPoint, Qt::QueuedConnection);
-    connect(thread, &QThread::started, worker, &Worker::process);
-    connect(worker, &Worker::resultReady, this, &PaintCanvas::handleResult);
-    connect(worker, &Worker::finished, worker, &QObject::deleteLater);
-    connect(worker, &Worker::finished, thread, &QThread::quit);
-
-    // connect finished -> custom slot with argument
-    connect(thread, &QThread::finished, this, [this, thread]() {
-        handleThreadFinished(thread);
-    });
-    connect(thread, &QThread::finished,
-            thread, &QObject::deleteLater);
-
+    // New stroke session on one of the service's running threads
+    m_currentStroke = m_strokeService->beginStroke(strokeProperties,
+        [this](const StrokeWorkerService::StrokeFit &fit, bool completedFinal) {
+            handleResult(fit, completedFinal);
+        });
+}
 
-    thread->start();
+GameFusion::StrokePoint PaintCanvas::strokeSample(const QPointF& scenePos, qint64 timestamp) const {
+    GameFusion::StrokePoint sample;
+    sample.pos = scenePos;
+    sample.pressure = currentPressure;
+    sample.timestamp = timestamp;
+    sample.xTilt = currentTilt.x();
+    sample.yTilt = currentTilt.y();
+    return sample;
 }
 
 // Implement mouse events
@@ -966,18 +1486,19 @@ void PaintCanvas::mousePressEvent(QMouseEvent *event) {
             m_scene->removeItem(m_tempStrokeItem);
             delete m_tempStrokeItem;
             m_tempStrokeItem = nullptr;
+            m_tempOpenItem = nullptr;
         }
 
         createThreadWorker();
 
         QPointF scenePos = mapToScene(pos);
-        QPainterPath path;
-        path.moveTo(pos);
-        m_tempStrokeItem = new QGraphicsPathItem(path);
 
         currentStrokePoints.push_back({event->pos(), currentPressure});
 
-        emit newPointAvailable(scenePos, currentPressure);
+        GameFusion::StrokePoint sample = strokeSample(scenePos, event->timestamp());
+        m_drawingOverlay->beginInk(viewportTransform());
+        m_drawingOverlay->addInk(sample, viewportTransform());
+        m_strokeService->addSample(m_currentStroke, sample);
 
         //layersUI[activeLayerIndex].layerGroup->hide();
 
@@ -990,6 +1511,13 @@ void PaintCanvas::mousePressEvent(QMouseEvent *event) {
         selectionRect.setBottomRight(mapToScene(pos));
         m_selectionItem->setRect(selectionRect);
         m_selectionItem->setVisible(true);
+    } else if (currentTool == ToolMode::Erase) {
+        isErasing = true;
+        eraserPath.clear();
+        m_eraseEdits.clear();
+        eraseStrokesAt(pos);
+    } else if (currentTool == ToolMode::Edit) {
+        m_editHandleHit = editHandleAt(pos);
     } // etc for other tools
     QGraphicsView::mousePressEvent(event);
 }
@@ -1004,27 +1532,19 @@ void PaintCanvas::mouseMoveEvent(QMouseEvent *event) {
         QPointF scenePos = mapToScene(pos);
 
 
-        if(!currentStrokeGroup){
-            currentStrokeGroup = new QGraphicsItemGroup;
-            m_scene->addItem(currentStrokeGroup);
-        }
-
-        float widths = strokeProperties.maxWidth * currentPressure;
-        QPen pen(Qt::black, widths, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
-        QPointF p0 = currentStrokePoints.end()->pos;
-        QPointF p1 = mapToScene(lastPos);
-        QPointF p2 = scenePos;
-        //QGraphicsLineItem* line = new QGraphicsLineItem(p1.x(), p1.y(), p2.x(), p2.y());
-        IndexedLineItem* line = new IndexedLineItem(p1.x(), p1.y(), p2.x(), p2.y(), currentStrokePoints.size());
-        line->setPen(pen);
-        currentStrokeGroup->addToGroup(line);
-
-        currentStrokePoints.push_back({scenePos, currentPressure});
-        emit newPointAvailable(scenePos, currentPressure);
+        GameFusion::StrokePoint sample = strokeSample(scenePos, event->timestamp());
+        currentStrokePoints.push_back(sample);
+        // Only the new segment is painted, into the overlay's ink buffer
+        m_drawingOverlay->addInk(sample, viewportTransform());
+        m_strokeService->addSample(m_currentStroke, sample);
         // worker will update via handleResult
     } else if (isSelecting) {
         selectionRect.setBottomRight(mapToScene(pos));
         m_selectionItem->setRect(selectionRect);
+    } else if (isErasing) {
+        eraseStrokesAt(pos);
+    } else if (currentTool == ToolMode::Edit) {
+        m_editHandleItem->setHighlight(editHandleAt(pos));
     } else if (currentHandleContext.isValid) {
         // handle drag, update positions, transforms
         // for example, for move, compute delta = mapToScene(pos) - mapToScene(lastPos)
@@ -1035,23 +1555,25 @@ void PaintCanvas::mouseMoveEvent(QMouseEvent *event) {
     lastPos = pos;
     QGraphicsView::mouseMoveEvent(event);
 
-    viewport()->update();
+    // The wet ink repaints just its own segment
+    if (!isDrawing)
+        viewport()->update();
 }
 
 void PaintCanvas::mouseReleaseEvent(QMouseEvent *event) {
     if (isDrawing) {
         isDrawing = false;
-        if (m_currentWorker) m_currentWorker->requestCompletion();
-
-        if(currentStrokeGroup){
-            delete currentStrokeGroup;
-            currentStrokeGroup = nullptr;
-        }
+        if (m_currentStroke) m_strokeService->endStroke(m_currentStroke);
 
     } else if (isSelecting) {
         isSelecting = false;
-        // process selection, find strokes in rect
         m_selectionItem->setVisible(false);
+        selectStrokesInRect(selectionRect);
+    } else if (isErasing) {
+        isErasing = false;
+        if (!m_eraseEdits.empty())
+            emit strokesErased(QString::fromStdString(layersUI[activeLayerIndex].layer.uuid), m_eraseEdits);
+        m_eraseEdits.clear();
     } // etc
     QGraphicsView::mouseReleaseEvent(event);
 }
@@ -1060,6 +1582,7 @@ void PaintCanvas::tabletEvent(QTabletEvent *event) {
 
     cursorPos = event->posF().toPoint();
     currentPressure = event->pressure(); // [0.0, 1.0]
+    currentTilt = QPointF(event->xTilt(), event->yTilt());
 
 
     if(m_verbose){
@@ -1081,24 +1604,29 @@ void PaintCanvas::tabletEvent(QTabletEvent *event) {
         isTabletActive = false;
         currentPressure = 0.0f;
         break;
-    case QEvent::TabletPress:
+    case QEvent::TabletPress: {
         isTabletActive = true;
-        mousePressEvent(new QMouseEvent(QEvent::MouseButtonPress, event->posF(), Qt::LeftButton, Qt::LeftButton, Qt::NoModifier));
+        QMouseEvent mouseEvent(QEvent::MouseButtonPress, event->posF(), Qt::LeftButton, Qt::LeftButton, Qt::NoModifier);
+        mouseEvent.setTimestamp(event->timestamp());
+        mousePressEvent(&mouseEvent);
         break;
-    case QEvent::TabletMove:
+    }
+    case QEvent::TabletMove: {
         isTabletActive = true;
-        if (currentPressure > 0) {
-
-            mouseMoveEvent(new QMouseEvent(QEvent::MouseMove, event->posF(), Qt::LeftButton, Qt::LeftButton, Qt::NoModifier));
-        } else {
-            mouseMoveEvent(new QMouseEvent(QEvent::MouseMove, event->posF(), Qt::NoButton, Qt::NoButton, Qt::NoModifier));
-        }
+        const Qt::MouseButton button = currentPressure > 0 ? Qt::LeftButton : Qt::NoButton;
+        QMouseEvent mouseEvent(QEvent::MouseMove, event->posF(), button, button, Qt::NoModifier);
+        mouseEvent.setTimestamp(event->timestamp());
+        mouseMoveEvent(&mouseEvent);
         break;
-    case QEvent::TabletRelease:
+    }
+    case QEvent::TabletRelease: {
         isTabletActive = true;
-        mouseReleaseEvent(new QMouseEvent(QEvent::MouseButtonRelease, event->posF(), Qt::LeftButton, Qt::LeftButton, Qt::NoModifier));
+        QMouseEvent mouseEvent(QEvent::MouseButtonRelease, event->posF(), Qt::LeftButton, Qt::LeftButton, Qt::NoModifier);
+        mouseEvent.setTimestamp(event->timestamp());
+        mouseReleaseEvent(&mouseEvent);
         isTabletActive = false;
         break;
+    }
     default:
         break;
     }
@@ -1174,16 +1702,6 @@ void PaintCanvas::keyReleaseEvent(QKeyEvent *event) {
     QGraphicsView::keyReleaseEvent(event);
 }
 
-// Implementation for handleThreadFinished (slot)
-void PaintCanvas::handleThreadFinished(QThread* thread) {
-    // Original implementation
-    int threadIndex = m_threads.indexOf(thread);
-    m_threads.removeOne(thread);
-    if (m_verbose) {
-        GameFusion::Log().print() << "Finishing thread " << threadIndex << "\n";
-    }
-}
-
 // Implementation for findHandleUnderCursor (private)
 HandleContext PaintCanvas::findHandleUnderCursor(const QPoint &pos) {
     // Implement logic to find handle under cursor
@@ -1215,6 +1733,32 @@ HandleContext PaintCanvas::findHandleUnderCursor(const QPoint &pos) {
     return context;
 }
 
+void PaintCanvas::motionBlurOffsets(LayerUI& layerUI, QVector<QPointF>& offsets) {
+    offsets.clear();
+    if (!layerUI.enableMotionBlur || layerUI.layer.motionKeyframes.size() < 2 || fps <= 0)
+        return;
+
+    // Shutter open for half a frame, centred on the current time
+    const double shutterMs = kMotionBlurShutter * 1000.0 / fps;
+    const LayerValues now = computeLayerValuesAtTime(layerUI.layer, currentTime, fps);
+    const LayerValues open = computeLayerValuesAtTime(layerUI.layer, currentTime - shutterMs * 0.5, fps);
+    const LayerValues close = computeLayerValuesAtTime(layerUI.layer, currentTime + shutterMs * 0.5, fps);
+
+    // One sample per screen pixel travelled, so slow layers cost a few blits
+    const double travel = (std::hypot(now.x - open.x, now.y - open.y) +
+                           std::hypot(close.x - now.x, close.y - now.y)) * std::max(1.0, m_zoomFactor);
+    const int samples = std::min(int(std::ceil(travel / kMotionBlurPixelsPerSample)), kMaxMotionBlurSamples);
+    if (samples < 2)
+        return;
+
+    offsets.reserve(samples);
+    for (int i = 0; i < samples; ++i) {
+        const double t = currentTime + shutterMs * (double(i) / (samples - 1) - 0.5);
+        const LayerValues values = computeLayerValuesAtTime(layerUI.layer, t, fps);
+        offsets.append(QPointF(values.x - now.x, values.y - now.y));
+    }
+}
+
 // Implementation for computeLayerValuesAtTime (private)
 LayerValues PaintCanvas::computeLayerValuesAtTime(const GameFusion::Layer& layer, double timeMs, float fps) {
     // Original logic: Interpolate layer values from keyframes
@@ -1262,6 +1806,7 @@ void PaintCanvas::setStrokeProperties(const StrokeProperties &props)
     if (strokeProperties.minWidth > strokeProperties.maxWidth) {
         strokeProperties.minWidth = strokeProperties.maxWidth;
     }
+    m_drawingOverlay->setStrokeProperties(strokeProperties);
 
     for (const auto& selStroke : currentSelection.selectedStrokes) {
         selStroke.stroke->setStrokeProperties(props);
@@ -1289,22 +1834,21 @@ void PaintCanvas::addStrokeToScene(const std::vector<GameFusion::Vector3D> &stro
     // Add to your active LayerGroupItem
     LayerGroupItem *activeGroup = m_layerItems[activeLayerIndex];
 
-    StrokeGroupItem *strokeGroup = new StrokeGroupItem;
-
-    for(int i=1; i<stroke.size(); i++){
-        const GameFusion::Vector3D &v1 = stroke[i-1];
-        const GameFusion::Vector3D &v2 = stroke[i];
-
-        QGraphicsLineItem *line = new QGraphicsLineItem(
-            v1.x(), v1.y(),
-            v2.x(), v2.y()
-            );
-        line->setPen(pen);
-        strokeGroup->addToGroup(line);
+    // One polyline item, so the tile cache can snapshot it for its raster
+    // tasks. It is not one of the layer's strokes, so it stays out of the
+    // stroke items, which follow layer.strokes index for index.
+    QPainterPath path;
+    for(int i=0; i<stroke.size(); i++){
+        const GameFusion::Vector3D &v = stroke[i];
+        if (i == 0)
+            path.moveTo(v.x(), v.y());
+        else
+            path.lineTo(v.x(), v.y());
     }
 
-    activeGroup->addToGroup(strokeGroup);
-    activeGroup->setUseRasterizedImage(true); // Using your existing method\
+    QGraphicsPathItem *strokeItem = new QGraphicsPathItem(path);
+    strokeItem->setPen(pen);
+    activeGroup->addRasterItem(strokeItem);
 
     //layersUI[activeLayerIndex].imageDirty = true;
     //updateCompositeImage();
@@ -13,9 +13,20 @@
 #include <QGraphicsItemGroup>
 #include <QElapsedTimer>
 #include <QGraphicsItem>
+#include <QStyleOptionGraphicsItem>
+#include <QPainter>
 //#include "BezierPath.h"
 #include "BezierCurve.h"
+#include "BezierHandleItem.h"
+#include "LayerCompositor.h"
+#include "LayerSourceStore.h"
+#include "LayerTileCache.h"
+#include "OnionSkinCache.h"
 #include "ScriptBreakdown.h"
+#include "StrokeEraser.h"
+#include "StrokeSpatialIndex.h"
+#include "StrokeWorkerService.h"
+#include "WetInkBuffer.h"
 #include "StrokeAttributeDockWidget.h"
 
 #include "PaintTypes.h"
@@ -27,6 +38,10 @@ class BrushInterface;
 #include <QWidget>
 #include <QMouseEvent>
 #include <QThread>
+#include <QUuid>
+// Point buffers are reserved once for strokes up to this many samples
+static const int kStrokePointReserve = 4096;
+
 class DrawingOverlay : public QWidget {
     Q_OBJECT
 public:
@@ -37,57 +52,79 @@ public:
         setStyleSheet("background: transparent;");  // Ensure no opaque bg
         setMouseTracking(true);  // For hover if needed
         // If using tablet: setAttribute(Qt::WA_TabletTracking, true);
+        lines.reserve(kStrokePointReserve);  // clear() keeps it for the next stroke
+        m_clock.start();
     }
 
     void clearStroke() {
-        m_path = QPainterPath();  // Reset path
         lines.clear();
-        update();  // Trigger repaint
+        clearInk();
     }
 
-    void addPoint(const QPointF &point) {
-        if (m_path.isEmpty()) {
-            m_path.moveTo(point);
-        } else {
-            m_path.lineTo(point);  // Or use quadTo for smoothing
-        }
-        update();  // Repaint overlay
+    // Own strokes are drawn in widget coordinates
+    void addPoint(const QPointF &point, qint64 timestamp = 0) {
+        GameFusion::StrokePoint sample;
+        sample.pos = point;
+        sample.timestamp = timestamp;
+        if (m_wetInk.isEmpty())
+            beginInk(QTransform());
+        addInk(sample, QTransform());
     }
 
     void setStrokeProperties(const StrokeProperties &props){
         strokeProperties = props;
+        m_wetInk.setStrokeProperties(props);
+    }
+
+    // ----- Wet ink: the stroke under the pen, painted segment by segment
+
+    void beginInk(const QTransform &sceneToView) {
+        m_wetInk.begin(sceneToView);
+        update();
     }
 
+    void addInk(const GameFusion::StrokePoint &sample, const QTransform &sceneToView) {
+        update(m_wetInk.addSample(sample, m_clock.nsecsElapsed(), sceneToView));
+    }
+
+    // The fitted curve covers the stroke up to pointIndex
+    void trimInk(int pointIndex) {
+        update(m_wetInk.trimTo(pointIndex));
+    }
+
+    void clearInk() {
+        m_wetInk.clear();
+        update();
+    }
+
+    const WetInkBuffer& wetInk() const { return m_wetInk; }
+    WetInkBuffer& wetInk() { return m_wetInk; }
+
 protected:
     void paintEvent(QPaintEvent *event) override {
         QPainter painter(this);
         painter.setRenderHints(QPainter::Antialiasing | QPainter::SmoothPixmapTransform);
-        // Set pen for variable width, color, etc. (from your strokeProperties)
-
-        QPen pen(strokeProperties.foregroundColor, strokeProperties.maxWidth, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
-        painter.setPen(pen);
-        painter.drawPath(m_path);
-
-        painter.drawLine(0, 0, width(), height());
+        m_wetInk.paint(painter, event->rect());
+        painter.end();
+        m_wetInk.presented(m_clock.nsecsElapsed());
+    }
 
-        for(int i=1; i<lines.size(); i++) {
-            GameFusion::Vector3D &p1 = lines[i-1];
-            GameFusion::Vector3D &p2 = lines[i];
-            painter.drawLine(p1.x_, p1.y_, p2.x_, p2.y_);
-        }
+    void resizeEvent(QResizeEvent *event) override {
+        QWidget::resizeEvent(event);
+        m_wetInk.resize(size(), devicePixelRatioF());
     }
 
     // Override mouse/tablet events to build path (example for mouse)
     void mousePressEvent(QMouseEvent *event) override {
         if (event->button() == Qt::LeftButton) {
-            addPoint(event->pos());
+            clearInk();
+            addPoint(event->pos(), event->timestamp());
         }
     }
 
     void mouseMoveEvent(QMouseEvent *event) override {
         if (event->buttons() & Qt::LeftButton) {
-            GameFusion::Log().info() << "Overlay point "<<event->pos().x()<<" "<<event->pos().y()<<"\n";
-            addPoint(event->pos());
+            addPoint(event->pos(), event->timestamp());
 
             GameFusion::Vector3D v(event->pos().x(), event->pos().y(), 0);
             lines.push_back(v);
@@ -101,67 +138,44 @@ protected:
         }
     }
 
-    void createThreadWorker() {
-
-        // Create new thread and worker for the stroke
-        QThread* thread = new QThread(this);
-        QString layerUuid = QUuid::createUuid().toString();
-        int activeLayerIndex = 0;
-        Worker* worker = new Worker(layerUuid, activeLayerIndex, 0, strokeProperties, 0);
-        worker->moveToThread(thread);
-        m_threads.append(thread);
-        m_currentWorker = worker;
-
-        connect(this, &DrawingOverlay::newPointAvailable, worker, &Worker::addPoint, Qt::QueuedConnection);
-        connect(thread, &QThread::started, worker, &Worker::process);
-        connect(worker, &Worker::resultReady, this, &DrawingOverlay::handleResult);
-        connect(worker, &Worker::finished, worker, &QObject::deleteLater);
-        connect(worker, &Worker::finished, thread, &QThread::quit);
-
-        // connect finished -> custom slot with argument
-        connect(thread, &QThread::finished, this, [this, thread]() {
-            handleThreadFinished(thread);
-        });
-        connect(thread, &QThread::finished,
-                thread, &QObject::deleteLater);
+public:
+    // Fitting workers run on the canvas' stroke threads
+    void setStrokeService(StrokeWorkerService* service) {
+        m_strokeService = service;
+    }
 
+    void createThreadWorker() {
+        if (!m_strokeService) return;
 
-        thread->start();
+        // New stroke session on an already running thread
+        m_currentStroke = m_strokeService->beginStroke(strokeProperties,
+            [this](const StrokeWorkerService::StrokeFit &fit, bool completedFinal) {
+                handleResult(fit, completedFinal);
+            });
     }
 
-    void handleResult(const WorkerResults &workerResults, bool completedFinal);
-
-    void handleThreadFinished(QThread* thread);
+    void handleResult(const StrokeWorkerService::StrokeFit &fit, bool completedFinal);
 
 signals:
     void strokeCompleted(const std::vector<GameFusion::Vector3D>& lines);
-    void newPointAvailable(const QPointF &pt, const float pressure);
 
 private:
-    QPainterPath m_path;  // Current stroke path
+    WetInkBuffer m_wetInk;
+    QElapsedTimer m_clock;  // sample arrival and present times
     StrokeProperties strokeProperties;
     std::vector<GameFusion::Vector3D> lines;
 
     //
     // ----- Thread and Bezier Compute from points BEGIN
     //
-    Worker* m_currentWorker = nullptr;
-    QList<QThread*> m_threads;
+    StrokeWorkerService* m_strokeService = nullptr;
+    int m_currentStroke = 0;              // stroke session id, 0 for none
     WorkerResults computeResult;
     int computePointIndex=0;
 };
 
 // --- DrawingOverlay END
 
-class IndexedLineItem : public QGraphicsLineItem {
-public:
-    IndexedLineItem(qreal x1, qreal y1, qreal x2, qreal y2, int index )
-        :QGraphicsLineItem(x1, y1, x2, y2){
-        pointIndex = index;
-    }
-    int pointIndex = -1;
-};
-
 /*
 // In paintcanvas.h (or new header)
 class LayerGroupItem : public QGraphicsItemGroup {
@@ -199,28 +213,127 @@ public:
 
 class LayerGroupItem : public QGraphicsItemGroup {
 public:
-    explicit LayerGroupItem(bool enableCache = true, int batchSize = 100)
-        : m_enableCache(enableCache), m_batchSize(batchSize), m_currentBatch(nullptr) {
+    explicit LayerGroupItem(bool enableCache = true)
+        : m_enableCache(enableCache) {
 
         //enableCache = true;
         if (enableCache) {
             setCacheMode(QGraphicsItem::ItemCoordinateCache);  // Cache if enabled (for subgroups)
         }
         setHandlesChildEvents(false);  // Optimize: no per-child interaction needed
+        setFlag(QGraphicsItem::ItemUsesExtendedStyleOption, true);  // Accurate exposedRect for tile culling
+
+        // Tiles are rastered and zoomed out mip tiles downsampled in the background
+        m_tileCache.setUpdateFunction([this]() {
+            update();
+            if (m_rasterProgress)
+                m_rasterProgress(m_tileCache.pendingTileCount());
+        });
+    }
+
+    // Add a stroke item. Stroke items are kept in the order of the layer's
+    // strokes so they can be removed by stroke index.
+    void addStroke(QGraphicsPathItem* stroke) {
+        m_strokeItems.append(stroke);
+        m_strokePrimitives.append(addRasterItem(stroke));
+    }
+
+    // Add an item to the layer. A snapshot of it goes into the tile cache,
+    // which paints it on top of the clean tiles under its bounding box, while
+    // missing tiles are created and rastered on the thread pool on next paint.
+    // When the layer is rasterized the item itself stays hidden. Returns the
+    // id of the snapshot in the tile cache.
+    int addRasterItem(QGraphicsPathItem* item) {
+        addToGroup(item);
+        if (m_useRasterizedImage)
+            item->hide();
+
+        RasterPrimitive primitive = rasterPrimitive(item);
+        QRectF itemRect = primitive.bounds;
+        int id = m_tileCache.append(primitive);
+        update(itemRect);
+        return id;
+    }
+
+    // Delete the item of the stroke at index and re-raster the tiles it covered
+    void removeStrokeAt(int index) {
+        QGraphicsPathItem* stroke = m_strokeItems.takeAt(index);
+        m_tileCache.remove(m_strokePrimitives.takeAt(index));
+        QRectF strokeRect = stroke->mapRectToParent(stroke->boundingRect());
+        removeFromGroup(stroke);
+        delete stroke;
+        update(strokeRect);
     }
 
-    // Add a stroke (or any child item). Automatically batches into cached subgroups.
-    void addStroke(QGraphicsItem* stroke) {
-        if (!m_currentBatch || m_currentBatch->childItems().size() >= m_batchSize) {
-            // Create a new cached batch group
-            m_currentBatch = new LayerGroupItem(true, m_batchSize);  // Recursive: subgroups cache
-            addToGroup(m_currentBatch);
+    // Replace the item of the stroke at index by the items of the pieces the
+    // eraser left of it, keeping its place in the stacking and paint order
+    void replaceStrokeAt(int index, const QVector<QGraphicsPathItem*>& pieces) {
+        QGraphicsPathItem* stroke = m_strokeItems.takeAt(index);
+        QVector<RasterPrimitive> primitives;
+        for (int k = 0; k < pieces.size(); ++k) {
+            QGraphicsPathItem* piece = pieces[k];
+            addToGroup(piece);
+            piece->stackBefore(stroke);
+            if (m_useRasterizedImage)
+                piece->hide();
+            primitives.append(rasterPrimitive(piece));
+            m_strokeItems.insert(index + k, piece);
         }
-        m_currentBatch->addToGroup(stroke);
-        // Optional: Enable cache on the stroke itself if not batching
-        // stroke->setCacheMode(QGraphicsItem::ItemCoordinateCache);
+        const QVector<int> ids = m_tileCache.replace(m_strokePrimitives.takeAt(index), primitives);
+        for (int k = 0; k < ids.size(); ++k)
+            m_strokePrimitives.insert(index + k, ids[k]);
+
+        QRectF strokeRect = stroke->mapRectToParent(stroke->boundingRect());
+        removeFromGroup(stroke);
+        delete stroke;
+        update(strokeRect);
     }
 
+    // Put the item of a stroke back at index (undo of an erase that took all
+    // of it), under the stroke that took its place in the paint order
+    void insertStrokeAt(int index, QGraphicsPathItem* stroke) {
+        if (index >= m_strokeItems.size()) {
+            addStroke(stroke);
+            return;
+        }
+        addToGroup(stroke);
+        stroke->stackBefore(m_strokeItems[index]);
+        if (m_useRasterizedImage)
+            stroke->hide();
+        RasterPrimitive primitive = rasterPrimitive(stroke);
+        QRectF strokeRect = primitive.bounds;
+        m_strokePrimitives.insert(index, m_tileCache.insert(m_strokePrimitives[index], primitive));
+        m_strokeItems.insert(index, stroke);
+        update(strokeRect);
+    }
+
+    // Delete all stroke items and drop the tile cache (full rebuild)
+    void clearStrokes() {
+        const QList<QGraphicsItem*> children = childItems();
+        for (QGraphicsItem* child : children) {
+            removeFromGroup(child);
+            delete child;
+        }
+        m_strokeItems.clear();
+        m_strokePrimitives.clear();
+        m_tileCache.clear();
+        update();
+    }
+
+    // Called with the number of tiles still rastering each time one lands
+    void setRasterProgressFunction(const std::function<void(int pendingTiles)>& progress) {
+        m_rasterProgress = progress;
+    }
+
+    // Re-raster the tiles under a dirty rectangle (in group coordinates) on next paint
+    void invalidateRasterizedImage(const QRectF& dirtyRect) {
+        m_tileCache.invalidate(dirtyRect);
+        update(dirtyRect);
+    }
+
+    const LayerTileCache& tileCache() const { return m_tileCache; }
+    LayerTileCache& tileCache() { return m_tileCache; }
+
     // Override paint for custom hints (applied to this group and propagates)
     void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget) override {
         painter->setRenderHint(QPainter::Antialiasing, true);
@@ -228,15 +341,8 @@ public:
         //QGraphicsItemGroup::paint(painter, option, widget);
 
         if (m_useRasterizedImage) {
-            // Draw the pre-rasterized pixmap instead of children
-            if (!m_rasterizedPixmap.isNull()) {
-                painter->drawPixmap(m_pixmapOffset, m_rasterizedPixmap);
-            }
-            else {
-                updateRasterizedImage();
-                if (!m_rasterizedPixmap.isNull())
-                    painter->drawPixmap(m_pixmapOffset, m_rasterizedPixmap);
-            }
+            // Draw the cached tiles intersecting the exposed area instead of children
+            m_tileCache.paint(painter, option->exposedRect);
         } else {
             // Normal painting of children
             QGraphicsItemGroup::paint(painter, option, widget);
@@ -254,74 +360,81 @@ public:
     void setUseRasterizedImage(bool enable) {
         if (enable == m_useRasterizedImage) return;
 
-        if (enable) {
-            // Update the rasterized image before hiding children
-            //update();
-            updateRasterizedImage();
-            // Hide all children to prevent them from painting
-            /*
-            for (QGraphicsItem* child : childItems()) {
-                child->hide();
-            }
-            */
-            // Delete all children (recursively deletes subgroups and strokes)
-
-        } else {
-            // Show all children
-            for (QGraphicsItem* child : childItems()) {
-                child->show();
-            }
-            m_rasterizedPixmap = QPixmap();  // Clear the pixmap
-            m_pixmapOffset = QPointF();
+        // Children are hidden while the tile cache stands in for them; the
+        // cache holds their snapshots either way, so only the tiles are redone
+        for (QGraphicsItem* child : childItems()) {
+            child->setVisible(!enable);
+            if (enable)
+                m_tileCache.invalidate(child->mapRectToParent(child->boundingRect()));
         }
+
+        // The tiles are the cache; an item cache on top would allocate the full bounds again
+        if (enable)
+            setCacheMode(QGraphicsItem::NoCache);
+        else if (m_enableCache)
+            setCacheMode(QGraphicsItem::ItemCoordinateCache);
+
         m_useRasterizedImage = enable;
         update();  // Trigger repaint
     }
 
 protected:
-    // Update the rasterized image by rendering the current state (with children visible)
-    // Update the rasterized image by rendering the current state (with children visible)
-    void updateRasterizedImage() {
-        QRectF bounds = boundingRect();
-        if (bounds.isEmpty()) return;
-
-        // Create a transparent image
-        QImage image(bounds.size().toSize(), QImage::Format_ARGB32_Premultiplied);
-        image.fill(Qt::transparent);
-
-        // Set up painter for rasterization
-        QPainter p(&image);
-        p.setRenderHint(QPainter::Antialiasing, true);
-        p.setRenderHint(QPainter::SmoothPixmapTransform, true);
-        p.translate(-bounds.topLeft());
-
-        // Prepare style option for rendering
-        QStyleOptionGraphicsItem opt;
-        opt.rect = bounds.toAlignedRect();
-        opt.exposedRect = bounds;
-
-        // Render the group (this will call paint recursively, but since m_useRasterizedImage is false here, it paints children)
-        QGraphicsItemGroup::paint(&p, &opt, nullptr);
-
-        // Store as pixmap with offset
-        m_rasterizedPixmap = QPixmap::fromImage(image);
-        m_pixmapOffset = bounds.topLeft();
-
-        while (!childItems().isEmpty()) {
-            delete childItems().first();
-        }
+    // Snapshot of a path item in group coordinates, for the raster tasks
+    RasterPrimitive rasterPrimitive(QGraphicsPathItem* item) const {
+        RasterPrimitive primitive;
+        primitive.path = item->path();
+        primitive.pen = item->pen();
+        primitive.brush = item->brush();
+        primitive.transform = item->itemTransform(this);
+        primitive.bounds = item->mapRectToParent(item->boundingRect());
+        return primitive;
     }
 
-
-
 private:
     bool m_enableCache;
-    int m_batchSize;
-    LayerGroupItem* m_currentBatch;
 
-    bool m_useRasterizedImage;
-    QPixmap m_rasterizedPixmap;
-    QPointF m_pixmapOffset;
+    bool m_useRasterizedImage = false;
+    LayerTileCache m_tileCache;
+    QList<QGraphicsPathItem*> m_strokeItems;    // one per layer stroke, in stroke order
+    QList<int> m_strokePrimitives;              // tile cache id of each stroke item
+    std::function<void(int)> m_rasterProgress;
+};
+
+// Draws the layers in place of their groups when any of them blends with
+// Multiply, Screen or Overlay, which the scene graph cannot do. The groups are
+// hidden meanwhile; their tile caches are read directly and blended by
+// LayerCompositor at the resolution of the paint device, so the viewport, the
+// PiP and exported frames all go through the same kernels.
+class LayerCompositeItem : public QGraphicsItem {
+public:
+    struct Source {
+        LayerGroupItem* group = nullptr;
+        GameFusion::BlendMode mode = GameFusion::BlendMode::Opacity;
+        float opacity = 1.0f;
+        // Motion blur: layer offsets at the sub-frame samples, relative to
+        // its current position; empty when not blurred
+        QVector<QPointF> blurOffsets;
+    };
+
+    LayerCompositeItem() {
+        setFlag(QGraphicsItem::ItemUsesExtendedStyleOption, true);  // composite the exposed area only
+    }
+
+    // Visible layers, bottom to top
+    void setSources(const QVector<Source>& sources) {
+        m_sources = sources;
+        update();
+    }
+
+    // Layers can be anywhere on the canvas
+    QRectF boundingRect() const override { return scene() ? scene()->sceneRect() : QRectF(); }
+    void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget) override;
+
+private:
+    QVector<Source> m_sources;
+    QImage m_target;                // reused between paints
+    QVector<QImage> m_layerImages;  // resampled layers, when not drawn 1:1
+    QVector<QImage> m_blurImages;   // accumulated sub-frames of blurred layers
 };
 
 // ----- Paint Canvas
@@ -369,9 +482,13 @@ public:
     void startPlayback();
     void addNewLayer(); // New method for adding layers
     void updateCompositeImage();
+    bool needsLayerCompositor() const; // a visible layer blends with something other than opacity
     void setActiveLayer(const QString& uuid);
     void setLayerVisibility(const QString& uuid, bool visible);
     void updateLayer(const GameFusion::Layer &layer);
+    // Redo or undo of an erase drag on a layer: only the items, index entries
+    // and tiles of the edited strokes are touched
+    void applyStrokeErase(const QString& layerUuid, const std::vector<GameFusion::StrokeErase>& edits, bool revert);
     void updateCamera(const GameFusion::CameraFrame &camera);
 
     //
@@ -380,6 +497,11 @@ public:
     void setPlaybackMode(bool);
     void setFpsDisplay(bool enabled); // Toggle FPS display
     void setPipDisplay(bool enabled); // Toggle PIP display
+    void setMotionPathDisplay(bool enabled); // Toggle motion path and camera frame overlays
+    // Camera preview at PiP size, re-rendered on first use after a layer, camera or time change
+    const QImage& currentPipImage();
+    bool hasPipImage() const { return !m_pipImage.isNull(); }
+    void invalidatePip();
     void invalidateAllLayers();
     SelectionSettings& selectionSettings();
 
@@ -398,13 +520,27 @@ public:
     void drawCameraFrame(const GameFusion::CameraFrame& frame, QImage &croppedView);
     void renderFrameToImage(QImage &frameImage);
     void renderScene(QPainter& painter, bool isExportMode = false);
-    void setExportMode(bool enabled) { m_exportMode = enabled; }
+    void setExportMode(bool enabled);
     bool isExportMode() const { return m_exportMode; }
     void setLightTableMode(bool enabled);
+    // Onion skin: the neighbouring panels of the shot, flattened, tinted and
+    // faded under the active panel
+    void setOnionSkinEnabled(bool enabled);
+    bool isOnionSkinEnabled() const { return m_onionSkinEnabled; }
+    void setOnionSkinSettings(const OnionSkinSettings& settings);
+    const OnionSkinSettings& onionSkinSettings() const { return m_onionSkinSettings; }
+    // Panels of the shot and the index of the one being edited. Call on each
+    // step and after a neighbour changed; only composites whose panel content
+    // changed are rendered again, one panel further on each side is prefetched.
+    void setOnionSkinPanels(const std::vector<GameFusion::Panel>& panels, int activeIndex);
+    // Drop the shared layer contents and onion skin composites of the open
+    // project; call when another project is loaded
+    void clearLayerSources();
     // --- motion path functions
     QPointF sceneToScreen(double x, double y);
     void renderMotionPath(QPainter &painter);
-    void updateMotionPaths(); // Compute motion paths for layers and cameras
+    void updateMotionPaths(); // Sync motion paths for layers and cameras, rebuilt only when keyframes or frames changed
+    void invalidateMotionPaths();
 
     void addStrokeToScene(const std::vector<GameFusion::Vector3D> &stroke);
 
@@ -415,7 +551,7 @@ signals:
     void cameraFrameDeleted(const QString& uuid);
     void layerAdded(const GameFusion::Layer &layer); // Signal for new layer
     void layerModified(const GameFusion::Layer &layer);
-    void layerErasedStrokes(const GameFusion::Layer &layer);
+    void strokesErased(const QString& layerUuid, const std::vector<GameFusion::StrokeErase>& edits);
     void layerThumbnailComputed(const QString& uuid, const QImage& thumbnail);
     void compositImageModified(const QString& panelUuid, const QImage& image, bool editing);
     void toolModeChanged(ToolMode mode); // Signal to notify mode change
@@ -445,15 +581,23 @@ private:
     QGraphicsScene *m_scene;
     //QVector<QGraphicsPixmapItem*> m_layerItems;
     QVector<LayerGroupItem*> m_layerItems;
+    QVector<GameFusion::StrokeSpatialIndex> m_strokeIndices;  // per layer, parallel to m_layerItems
     QGraphicsItem *m_tempStrokeItem = nullptr;
+    QGraphicsPathItem *m_tempOpenItem = nullptr;    // open segment, child of m_tempStrokeItem
     QGraphicsRectItem *m_selectionItem = nullptr;
     QGraphicsEllipseItem *m_cursorItem = nullptr;
     QGraphicsPathItem *m_cameraMotionPathItem = nullptr;
     QVector<QGraphicsRectItem*> m_cameraFrameItems;
     QVector<QGraphicsItemGroup*> m_cameraHandleGroups;
     QVector<QGraphicsPathItem*> m_layerMotionPathItems;
-    QVector<QGraphicsItemGroup*> m_layerMotionHandleGroups;
-    QGraphicsItemGroup *m_editBezierGroup = nullptr;
+    QVector<QGraphicsPathItem*> m_layerMotionHandleItems;  // keyframe dots, parallel to m_layerMotionPathItems
+    QGraphicsPathItem *m_motionPlayheadItem = nullptr;      // layer positions at currentTime
+    std::vector<double> m_motionOverlayKey;                // keyframes / frames the overlays were built from
+    std::vector<double> m_motionOverlayScratch;
+    bool m_motionOverlayValid = false;
+    BezierHandleItem *m_editHandleItem = nullptr;
+    LayerCompositeItem *m_layerCompositeItem = nullptr;
+    BezierHandleItem::Hit m_editHandleHit;     // handle pressed in Edit mode
     QList<LayerUI> layersUI;
     LayerUI copiedLayerUI;
     bool hasCopiedLayer = false;
@@ -486,10 +630,32 @@ private:
     void computeLayerImage(LayerUI& layerUI);
     //QRectF drawBezierCurve(QPainter& painter, GameFusion::BezierCurve& curve);
     QRectF drawBezierCurve(LayerGroupItem* group, GameFusion::BezierCurve& curve);
+    QGraphicsPathItem* createStrokeItem(GameFusion::BezierCurve& curve);
+    void commitStrokeToLayer(LayerUI& layerUI, GameFusion::BezierCurve& curve);
+    GameFusion::StrokeSpatialIndex& strokeIndex(const LayerUI& layerUI);
+    // Layer tiles queued or rastering on the thread pool, over all layers
+    int pendingRasterTiles() const;
+public:
+    // Pen sample to wet ink on screen, over the recent samples (ms)
+    double inkLatencyP50() const { return m_drawingOverlay->wetInk().latencyP50(); }
+    double inkLatencyP99() const { return m_drawingOverlay->wetInk().latencyP99(); }
+    // Extrapolate the wet ink ahead of the pen from its velocity
+    void setInkPrediction(bool enabled) { m_drawingOverlay->wetInk().setPredictionEnabled(enabled); }
+    // Commit-time simplification of finished strokes (px of deviation, 0 off)
+    // and the handles it saved since the last reset, e.g. per project
+    void setStrokeSimplifyTolerance(double pixels) { m_strokeService->setSimplifyTolerance(pixels); }
+    const StrokeWorkerService::SimplifyStats& strokeSimplifyStats() const { return m_strokeService->simplifyStats(); }
+    void resetStrokeSimplifyStats() { m_strokeService->resetSimplifyStats(); }
+private:
+    void selectStrokesInRect(const QRectF& sceneRect);
+    void eraseStrokesAt(const QPoint& pos);
     QImage generateThumbnail(const QImage& sourceImage, const QRectF& sourceBounds);
     void renderHDCameraView(QPainter& painter, const QRectF& cameraRect, qreal rotation, qreal zoom, long currentTimeMs, float fps);
     void prepareLayerImages();
     LayerValues computeLayerValuesAtTime(const GameFusion::Layer& layer, double timeMs, float fps);
+    // Sub-frame offsets of a motion blurred layer over the shutter interval
+    // around currentTime; empty when it is not blurred or not moving
+    void motionBlurOffsets(LayerUI& layerUI, QVector<QPointF>& offsets);
     void setCameraAnimationMode(CameraAnimationMode cameraAnimationMode);
 
     CameraAnimationMode m_cameraAnimationMode = CameraAnimationMode::Linear;
@@ -511,6 +677,10 @@ private:
     // fps counter
     bool showFps = false;            // Enable/disable display
     bool showPip = true;
+    bool showMotionPaths = true;
+    QImage m_pipImage;
+    bool m_pipDirty = true;
+    void renderPip(QImage &pipImg);
     int frameCount = 0;
     QElapsedTimer fpsTimer;
     float currentFps = 0.0f;
@@ -523,6 +693,8 @@ private:
     // Selection Vars
     QRectF selectionRect; // For drawing selection in ToolMode::Select
     bool isSelecting = false; // Tracks if selection rect is being drawn
+    bool isErasing = false; // Erase tool drag in progress
+    std::vector<GameFusion::StrokeErase> m_eraseEdits; // Edits of the current erase drag, in order
     bool isEditing = false;
     SelectionFrameUI currentSelection; // Current selection frame
     bool hasSelection = false; // Tracks if a selection is active
@@ -536,6 +708,21 @@ private:
     bool m_exportMode = false;
     bool m_lightTableMode = false;  // New: Light table (onion-skin) mode
 
+    // Onion skin of neighbouring panels
+    struct OnionSkinPanel {
+        QString uuid;
+        int distance = 1;       // panels away from the active one
+        bool previous = true;   // before the active panel in the shot
+    };
+    OnionSkinCache m_onionSkinCache;
+    // Strokes and rasters of instanced layers, shared with the render tasks
+    std::shared_ptr<LayerSourceStore> m_layerSources = std::make_shared<LayerSourceStore>();
+    OnionSkinSettings m_onionSkinSettings;
+    QVector<OnionSkinPanel> m_onionSkinPanels;  // shown, nearest first
+    QGraphicsPixmapItem *m_onionSkinItem = nullptr;
+    bool m_onionSkinEnabled = false;
+    void updateOnionSkinItem();
+
     // Interactive Motion Paths Context
     struct MotionHandleContext {
         QString uuid;
@@ -545,6 +732,12 @@ private:
     };
 
     std::vector<MotionHandleContext> motionHandleContext;
+    bool motionOverlaysVisible() const { return showMotionPaths && !m_exportMode; }
+    void setMotionOverlayItemsVisible(bool visible);
+    void buildMotionOverlayKey(std::vector<double>& key) const;
+    void syncLayerMotionItems();
+    void syncCameraFrameItems();
+    void updateMotionPlayhead();
     bool updateMotionHandleContext = true;
     int draggedKeyFrameIndex = -1;
     QString draggedLayerUuid;
@@ -556,41 +749,40 @@ private:
     // tablet & pressure vars
     bool isTabletActive = false;
     float currentPressure = 1.0f; // Default for mouse
+    QPointF currentTilt;          // pen x / y tilt in degrees, 0 for mouse
     std::vector<GameFusion::StrokePoint> currentStrokePoints;
 
     //
     // ----- Thread and Bezier Compute from points BEGIN
     //
-    Worker* m_currentWorker = nullptr;
-    QList<QThread*> m_threads;
-    WorkerResults computeResult;
+    StrokeWorkerService* m_strokeService = nullptr;
+    int m_currentStroke = 0;              // stroke session id, 0 for none
     int computePointIndex=0;
 
 public:
     static void performLocalFit(FitResult& result, const std::vector<GameFusion::StrokePoint>& points, const StrokeProperties& props);
 
 private slots:
-    void handleResult(const WorkerResults &workerResults, bool completedFinal);
-    void handleThreadFinished(QThread* thread);
+    void handleResult(const StrokeWorkerService::StrokeFit &fit, bool completedFinal);
 
-signals:
-    void newPointAvailable(const QPointF &pt, const float pressure);
     //
     // ----- Thread and Bezier Compute from points END
     //
 
 private:
     static bool m_verbose;
-    void updateTempStrokeItem();
+    void updateTempStrokeItem(const StrokeWorkerService::StrokeFit& fit);
+    void setTempStrokePath(QGraphicsPathItem* item, const GameFusion::BezierCurve& curve) const;
     void updateEditBezierGroup();
+    BezierHandleItem::Hit editHandleAt(const QPoint& pos) const;
     void updateCameraFrameItems();
     void updateLayerTransforms();
 
     void createReferenceBorder();
 
     void createThreadWorker();
-
-    QGraphicsItemGroup* currentStrokeGroup = nullptr;
+    // Pen sample at scenePos with the current pressure and tilt
+    GameFusion::StrokePoint strokeSample(const QPointF& scenePos, qint64 timestamp) const;
 
     DrawingOverlay *m_drawingOverlay;
 
@@ -265,6 +265,7 @@ void ScriptBreakdown::addShotFromJson(const QJsonObject& obj, Scene& scene) {
                     if (layerObj.contains("strokes")) {
                         QJsonArray strokeArray = layerObj["strokes"].toArray();
                         //layer.strokes.clear(); // Clear existing strokes
+                        layer.strokes.reserve(layer.strokes.size() + strokeArray.size());
 
                         for (const auto& strokeVal : strokeArray) {
 
@@ -273,7 +274,7 @@ void ScriptBreakdown::addShotFromJson(const QJsonObject& obj, Scene& scene) {
 
                                 QJsonObject strokeObj = strokeVal.toObject();
 
-                                path.fromJson(strokeObj); // Deserialize handles and strokeProperties
+                                path.fromJson(strokeObj); // Deserialize handles and strokeProperties; geometry is derived on first use
                                 layer.strokes.push_back(path);
                             }
                             else {
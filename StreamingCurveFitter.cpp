@@ -0,0 +1,288 @@
+#include "StreamingCurveFitter.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace GameFusion {
+
+namespace {
+
+// Bernstein weights of the two inner control points, and of the end point
+// as it enters through both P2 = P3 + beta T3 and P3 (b2 + b3), in power basis
+const double kB1[4] = {0.0, 3.0, -6.0, 3.0};
+const double kB2[4] = {0.0, 0.0, 3.0, -3.0};
+const double kEnd[4] = {0.0, 0.0, 3.0, -2.0};
+
+// Segments are closed at this many samples even within tolerance, which
+// bounds the rounding in the power sums
+const int kMaxSegmentSamples = 1024;
+
+// Handle lengths below this fraction of the chord are taken as a failed solve
+const double kMinHandleRatio = 1e-3;
+
+double tangentReach(double tolerance) {
+    return std::max(3.0 * tolerance, 2.0);
+}
+
+bool normalize(double& x, double& y) {
+    const double length = std::sqrt(x * x + y * y);
+    if (length <= 0.0)
+        return false;
+    x /= length;
+    y /= length;
+    return true;
+}
+
+Vector3D toVector(double x, double y) {
+    return Vector3D(static_cast<float>(x), static_cast<float>(y), 0.0f);
+}
+
+} // namespace
+
+void StreamingCurveFitter::reset() {
+    m_sampleCount = 0;
+    m_handles.clear();
+    m_pressures.clear();
+    m_hasFit = false;
+    m_hasTangent = false;
+    m_count = 0;
+    m_tailCount = 0;
+    m_tailHead = 0;
+}
+
+void StreamingCurveFitter::startSegment(const Sample& start, double tangentX, double tangentY, bool hasTangent) {
+    m_start = start;
+    m_start.s = 0.0;
+    m_tangentX = tangentX;
+    m_tangentY = tangentY;
+    m_hasTangent = hasTangent;
+    m_hasFit = false;
+    m_count = 0;
+    std::fill(std::begin(m_moments), std::end(m_moments), 0.0);
+    std::fill(std::begin(m_momentsX), std::end(m_momentsX), 0.0);
+    std::fill(std::begin(m_momentsY), std::end(m_momentsY), 0.0);
+    m_sumSquares = 0.0;
+    accumulate(m_start);
+}
+
+void StreamingCurveFitter::accumulate(const Sample& sample) {
+    const double qx = sample.x - m_start.x;
+    const double qy = sample.y - m_start.y;
+    double power = 1.0;
+    for (int k = 0; k < 7; ++k) {
+        m_moments[k] += power;
+        if (k < 4) {
+            m_momentsX[k] += power * qx;
+            m_momentsY[k] += power * qy;
+        }
+        power *= sample.s;
+    }
+    m_sumSquares += qx * qx + qy * qy;
+    ++m_count;
+    m_last = sample;
+}
+
+void StreamingCurveFitter::endTangent(double& x, double& y) const {
+    // Back from the newest sample to the first one far enough to be steady
+    const double reach = tangentReach(m_tolerance);
+    x = m_start.x - m_last.x;
+    y = m_start.y - m_last.y;
+    for (int i = 1; i < m_tailCount; ++i) {
+        const Sample& sample = m_tail[(m_tailHead - 1 - i + kTailSize) % kTailSize];
+        x = sample.x - m_last.x;
+        y = sample.y - m_last.y;
+        if (x * x + y * y >= reach * reach)
+            break;
+    }
+    if (!normalize(x, y)) {
+        x = -m_tangentX;
+        y = -m_tangentY;
+    }
+}
+
+bool StreamingCurveFitter::solve(CubicBezier& fit, double& rms) const {
+    const double length = m_last.s;
+    if (m_count < 2 || length <= 0.0)
+        return false;
+
+    // Sums over t = s / length
+    double t[7], tx[4], ty[4];
+    double scale = 1.0;
+    for (int k = 0; k < 7; ++k) {
+        t[k] = m_moments[k] * scale;
+        if (k < 4) {
+            tx[k] = m_momentsX[k] * scale;
+            ty[k] = m_momentsY[k] * scale;
+        }
+        scale /= length;
+    }
+    auto product = [&t](const double* a, const double* b) {
+        double sum = 0.0;
+        for (int m = 1; m < 4; ++m)
+            for (int n = 1; n < 4; ++n)
+                sum += a[m] * b[n] * t[m + n];
+        return sum;
+    };
+    auto momentX = [&tx](const double* a) { return a[1] * tx[1] + a[2] * tx[2] + a[3] * tx[3]; };
+    auto momentY = [&ty](const double* a) { return a[1] * ty[1] + a[2] * ty[2] + a[3] * ty[3]; };
+
+    // Chord, start tangent (the chord until the first samples fix it) and end
+    // tangent pointing back into the curve
+    const double cx = m_last.x - m_start.x, cy = m_last.y - m_start.y;
+    const double chord = std::sqrt(cx * cx + cy * cy);
+    double t0x = m_tangentX, t0y = m_tangentY;
+    if (!m_hasTangent) {
+        t0x = cx;
+        t0y = cy;
+        if (!normalize(t0x, t0y))
+            return false;
+    }
+    double t3x, t3y;
+    endTangent(t3x, t3y);
+
+    const double s11 = product(kB1, kB1), s12 = product(kB1, kB2), s22 = product(kB2, kB2);
+    const double s1e = product(kB1, kEnd), s2e = product(kB2, kEnd), see = product(kEnd, kEnd);
+    const double b1x = momentX(kB1), b1y = momentY(kB1);
+    const double b2x = momentX(kB2), b2y = momentY(kB2);
+    const double ex = momentX(kEnd), ey = momentY(kEnd);
+
+    // Normal equations in the two handle lengths
+    const double tangentDot = t0x * t3x + t0y * t3y;
+    Matrix2x2 A{s11, s12 * tangentDot, s12 * tangentDot, s22};
+    const double r1 = t0x * b1x + t0y * b1y - s1e * (t0x * cx + t0y * cy);
+    const double r2 = t3x * b2x + t3y * b2y - s2e * (t3x * cx + t3y * cy);
+    const Vector3D solution = solve2x2(A, r1, r2);    // zero when singular
+    double alpha = solution.x(), beta = solution.y();
+    if (alpha < kMinHandleRatio * chord || beta < kMinHandleRatio * chord || alpha > length || beta > length)
+        alpha = beta = chord / 3.0;  // too few samples or a degenerate fit
+
+    // Squared residual from the same sums
+    const double ax = alpha * t0x, ay = alpha * t0y;
+    const double bx = beta * t3x, by = beta * t3y;
+    const double cross = ax * b1x + ay * b1y + bx * b2x + by * b2y + cx * ex + cy * ey;
+    const double model = (ax * ax + ay * ay) * s11 + (bx * bx + by * by) * s22 + chord * chord * see
+                         + 2.0 * ((ax * bx + ay * by) * s12 + (ax * cx + ay * cy) * s1e + (bx * cx + by * cy) * s2e);
+    rms = std::sqrt(std::max(m_sumSquares - 2.0 * cross + model, 0.0) / m_count);
+
+    fit.p0 = toVector(m_start.x, m_start.y);
+    fit.p1 = toVector(m_start.x + ax, m_start.y + ay);
+    fit.p2 = toVector(m_last.x + bx, m_last.y + by);
+    fit.p3 = toVector(m_last.x, m_last.y);
+    return true;
+}
+
+void StreamingCurveFitter::addPoint(const StrokePoint& point) {
+    Sample sample;
+    sample.x = point.pos.x();
+    sample.y = point.pos.y();
+    sample.pressure = point.pressure;
+
+    if (m_sampleCount == 0) {
+        m_handles.emplace_back(toVector(sample.x, sample.y), Vector3D(), Vector3D());
+        m_pressures.push_back(sample.pressure);
+        startSegment(sample, 0.0, 0.0, false);
+        pushTail(sample);
+    } else {
+        const double step = std::hypot(sample.x - m_last.x, sample.y - m_last.y);
+        if (step <= 0.0)
+            return;  // repeated position
+        sample.s = m_last.s + step;
+        accumulate(sample);
+        pushTail(sample);
+
+        // The first segment's start tangent is fixed once the pen has moved far
+        // enough for it to be steady
+        if (!m_hasTangent && m_handles.size() == 1) {
+            double dx = sample.x - m_start.x, dy = sample.y - m_start.y;
+            const double reach = tangentReach(m_tolerance);
+            if (dx * dx + dy * dy >= reach * reach && normalize(dx, dy)) {
+                m_tangentX = dx;
+                m_tangentY = dy;
+                m_hasTangent = true;
+            }
+        }
+
+        // Without a fit (the samples are back at the segment start and no
+        // tangent is known yet) the previous fit, if any, stays
+        CubicBezier fit;
+        double rms = 0.0;
+        const bool solved = solve(fit, rms);
+        if (solved && m_hasFit && m_count >= 3 && (rms > m_tolerance || m_count > kMaxSegmentSamples)) {
+            // Freeze the last fit within tolerance, which ends at the previous
+            // sample unless that one could not be fitted, and go on from its
+            // end with its end tangent
+            const Sample end = m_fitEnd;
+            m_handles.back().rightControl = m_fit.p1 - m_fit.p0;
+            m_handles.emplace_back(m_fit.p3, m_fit.p2 - m_fit.p3, Vector3D());
+            m_pressures.push_back(end.pressure);
+
+            double tx = double(m_fit.p3.x()) - m_fit.p2.x(), ty = double(m_fit.p3.y()) - m_fit.p2.y();
+            const bool hasTangent = normalize(tx, ty);
+            startSegment(end, tx, ty, hasTangent);
+            sample.s = std::hypot(sample.x - end.x, sample.y - end.y);
+            accumulate(sample);
+            if (solve(fit, rms))
+                setFit(fit);
+        } else if (solved) {
+            setFit(fit);
+        }
+    }
+    ++m_sampleCount;
+}
+
+void StreamingCurveFitter::setFit(const CubicBezier& fit) {
+    m_fit = fit;
+    m_fitEnd = m_last;
+    m_hasFit = true;
+}
+
+void StreamingCurveFitter::pushTail(const Sample& sample) {
+    m_tail[m_tailHead] = sample;
+    m_tailHead = (m_tailHead + 1) % kTailSize;
+    m_tailCount = std::min(m_tailCount + 1, kTailSize);
+}
+
+BezierCurve StreamingCurveFitter::curve() const {
+    BezierCurve result;
+    if (m_sampleCount == 0)
+        return result;
+
+    std::vector<float> pressures = m_pressures;
+    for (size_t i = 0; i < m_handles.size(); ++i) {
+        BezierControl handle = m_handles[i];
+        if (i + 1 == m_handles.size() && m_hasFit)
+            handle.rightControl = m_fit.p1 - m_fit.p0;
+        result += handle;
+    }
+    if (m_hasFit) {
+        result += BezierControl(m_fit.p3, m_fit.p2 - m_fit.p3, Vector3D());
+        pressures.push_back(m_last.pressure);
+    }
+    result.setStrokePressure(pressures);
+    return result;
+}
+
+BezierCurve StreamingCurveFitter::finalizedCurve(int first) const {
+    BezierCurve result;
+    first = std::max(first, 0);
+    if (first >= int(m_handles.size()))
+        return result;
+    for (size_t i = first; i < m_handles.size(); ++i)
+        result += m_handles[i];
+    result.setStrokePressure(std::vector<float>(m_pressures.begin() + first, m_pressures.end()));
+    return result;
+}
+
+BezierCurve StreamingCurveFitter::openCurve() const {
+    BezierCurve result;
+    if (!m_hasFit)
+        return result;
+    BezierControl start = m_handles.back();
+    start.rightControl = m_fit.p1 - m_fit.p0;
+    result += start;
+    result += BezierControl(m_fit.p3, m_fit.p2 - m_fit.p3, Vector3D());
+    result.setStrokePressure({m_pressures.back(), m_last.pressure});
+    return result;
+}
+
+} // namespace GameFusion
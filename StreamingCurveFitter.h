@@ -0,0 +1,100 @@
+#ifndef STREAMINGCURVEFITTER_H
+#define STREAMINGCURVEFITTER_H
+
+#include <cstddef>
+#include <vector>
+#include "BezierCurve.h"
+
+namespace GameFusion {
+
+// Least-squares cubic fit of a pen stroke, updated as samples arrive.
+//
+// Only the open (last) segment is ever solved. Its samples are kept as running
+// moments over their chord length from the segment start (the running form of
+// chordParams): sums of s^k, s^k x and s^k y. Normalizing s by the current
+// segment length turns them into the sums the Bernstein normal equations and
+// the squared residual are made of, so each sample costs the same whatever
+// the segment or stroke length.
+//
+// The segment keeps its start point and start tangent (G1 with the previous
+// one) and ends at the newest sample, with the end tangent taken from the
+// last few samples; only the two handle lengths are solved (solve2x2). When
+// the root mean square distance of the samples from the fit goes over the
+// tolerance, the previous fit is frozen as a finalized handle and a new
+// segment starts at the previous sample.
+class StreamingCurveFitter {
+public:
+    explicit StreamingCurveFitter(double tolerance = 1.0) : m_tolerance(tolerance) {}
+
+    void setTolerance(double tolerance) { m_tolerance = tolerance; }
+    double tolerance() const { return m_tolerance; }
+
+    // Forget the stroke, keeping the tolerance
+    void reset();
+
+    void addPoint(const StrokePoint& point);
+
+    // Handles that no later sample moves any more. The segments between them
+    // are final; the last one's right control belongs to the open segment.
+    const std::vector<BezierControl>& finalizedHandles() const { return m_handles; }
+    int sampleCount() const { return m_sampleCount; }
+
+    // Finalized handles plus the open segment's fit, with a per-handle pressure
+    // track. A single sample gives a one-handle dot, no samples an empty curve.
+    BezierCurve curve() const;
+
+    // Finalized handles from first on, with their pressures: the segments
+    // finalized since a caller last had handle first. O(handles copied).
+    BezierCurve finalizedCurve(int first) const;
+    // The open segment as a two-handle curve, from the last finalized handle;
+    // empty before there is a fit
+    BezierCurve openCurve() const;
+
+private:
+    // Power basis polynomial in t, degree 3
+    using Poly = double[4];
+
+    struct Sample {
+        double x = 0.0, y = 0.0;
+        double s = 0.0;         // chord length from the segment start
+        float pressure = 1.0f;
+    };
+
+    void startSegment(const Sample& start, double tangentX, double tangentY, bool hasTangent);
+    void accumulate(const Sample& sample);
+    // Fit of the open segment to its samples; false with fewer than two
+    bool solve(CubicBezier& fit, double& rms) const;
+    void setFit(const CubicBezier& fit);
+    void endTangent(double& x, double& y) const;
+    void pushTail(const Sample& sample);
+
+    double m_tolerance;
+    int m_sampleCount = 0;
+
+    std::vector<BezierControl> m_handles;
+    std::vector<float> m_pressures;
+
+    // Open segment
+    Sample m_start;
+    Sample m_last;
+    double m_tangentX = 0.0, m_tangentY = 0.0;  // unit start tangent
+    bool m_hasTangent = false;      // fixed by the previous segment or the first samples
+    int m_count = 0;                // samples, start included
+    double m_moments[7] = {};       // sum of s^k
+    double m_momentsX[4] = {};      // sum of s^k (x - start x)
+    double m_momentsY[4] = {};
+    double m_sumSquares = 0.0;      // sum of |p - start|^2
+    CubicBezier m_fit;              // last fit within tolerance
+    Sample m_fitEnd;                // sample m_fit ends at
+    bool m_hasFit = false;
+
+    // Newest samples, for the end tangent
+    static const int kTailSize = 16;
+    Sample m_tail[kTailSize];
+    int m_tailCount = 0;
+    int m_tailHead = 0;             // slot of the next sample
+};
+
+} // namespace GameFusion
+
+#endif // STREAMINGCURVEFITTER_H
@@ -0,0 +1,153 @@
+#include "StrokeEraser.h"
+
+#include <algorithm>
+#include <cmath>
+#include "CurveIntersector.h"
+#include "StrokeSpatialIndex.h"
+
+namespace GameFusion {
+
+namespace {
+
+// Handle length of a quarter circle as a cubic, per unit radius
+const float kQuarterArc = 0.5522847f;
+
+// Surviving ranges shorter than this (in params) are dropped
+const float kMinPieceParam = 1e-4f;
+
+double distanceToSegment(const Vector3D& p, const Vector3D& a, const Vector3D& b) {
+    const double abx = b.x() - a.x(), aby = b.y() - a.y();
+    const double len2 = abx * abx + aby * aby;
+    double t = 0.0;
+    if (len2 > 0.0)
+        t = std::clamp(((p.x() - a.x()) * abx + (p.y() - a.y()) * aby) / len2, 0.0, 1.0);
+    const double dx = a.x() + abx * t - p.x();
+    const double dy = a.y() + aby * t - p.y();
+    return std::sqrt(dx * dx + dy * dy);
+}
+
+Vector3D pointAt(const BezierCurve& curve, float param) {
+    const int segment = std::clamp(int(param), 0, curve.segmentCount() - 1);
+    return curve.segment(segment).evaluate(param - segment);
+}
+
+} // namespace
+
+BezierCurve StrokeEraser::footprint(const Vector3D& a, const Vector3D& b, float radius) {
+    float dx = b.x() - a.x(), dy = b.y() - a.y();
+    const float length = std::sqrt(dx * dx + dy * dy);
+    if (length > 0.0f) {
+        dx /= length;
+        dy /= length;
+    } else {
+        dx = 1.0f;      // a dab: the straight sides collapse and a circle remains
+        dy = 0.0f;
+    }
+    const Vector3D d(dx * radius, dy * radius, 0.0f);
+    const Vector3D n(-dy * radius, dx * radius, 0.0f);
+    const Vector3D dk = d * kQuarterArc, nk = n * kQuarterArc;
+    const Vector3D zero(0.0f, 0.0f, 0.0f);
+
+    // Along one side, round b, back along the other side and round a
+    const Vector3D p0 = a + n, p1 = b + n, p3 = b - n, p4 = a - n;
+    BezierCurve outline;
+    outline += BezierControl(p0, zero, (p1 - p0) * (1.0f / 3.0f));
+    outline += BezierControl(p1, (p0 - p1) * (1.0f / 3.0f), dk);
+    outline += BezierControl(b + d, nk, zero - nk);
+    outline += BezierControl(p3, dk, (p4 - p3) * (1.0f / 3.0f));
+    outline += BezierControl(p4, (p3 - p4) * (1.0f / 3.0f), zero - dk);
+    outline += BezierControl(a - d, zero - nk, nk);
+    outline += BezierControl(p0, zero - dk, zero);
+    return outline;
+}
+
+std::vector<std::pair<float, float>> StrokeEraser::survivingRanges(const BezierCurve& curve,
+                                                                   const Vector3D& a, const Vector3D& b, float radius) {
+    std::vector<std::pair<float, float>> ranges;
+    const int segments = curve.segmentCount();
+    if (segments == 0) {
+        if (!curve.empty() && distanceToSegment(curve[0].point, a, b) > radius)
+            ranges.emplace_back(0.0f, 0.0f);
+        return ranges;
+    }
+
+    // Entry and exit points split the curve into stretches lying wholly inside
+    // or outside; each is classified by its middle, which also sorts out
+    // tangent touches
+    std::vector<float> cuts{0.0f};
+    for (const CurveCrossing& crossing : CurveIntersector(footprint(a, b, radius)).intersect(curve))
+        cuts.push_back(crossing.param());
+    cuts.push_back(float(segments));
+
+    for (size_t i = 0; i + 1 < cuts.size(); ++i) {
+        const float from = cuts[i], to = cuts[i + 1];
+        if (to - from < kMinPieceParam)
+            continue;
+        if (distanceToSegment(pointAt(curve, (from + to) * 0.5f), a, b) <= radius)
+            continue;
+        if (!ranges.empty() && from - ranges.back().second < kMinPieceParam)
+            ranges.back().second = to;
+        else
+            ranges.emplace_back(from, to);
+    }
+    return ranges;
+}
+
+std::vector<StrokeErase> StrokeEraser::erase(std::vector<BezierCurve>& strokes, StrokeSpatialIndex& index,
+                                             const Vector3D& a, const Vector3D& b, float radius) {
+    std::vector<StrokeErase> edits;
+
+    BBox query;
+    query.minX = std::min(a.x(), b.x()) - radius;
+    query.maxX = std::max(a.x(), b.x()) + radius;
+    query.minY = std::min(a.y(), b.y()) - radius;
+    query.maxY = std::max(a.y(), b.y()) + radius;
+    std::vector<int> candidates;
+    for (const auto& hit : index.querySegments(query)) {
+        if (candidates.empty() || candidates.back() != hit.first)
+            candidates.push_back(hit.first);
+    }
+
+    // Increasing ids, shifted by the pieces added before them
+    int shift = 0;
+    for (int id : candidates) {
+        const BezierCurve& curve = strokes[id + shift];
+        const float reach = radius + float(curve.getStrokeProperties().maxWidth) * 0.5f;
+        const std::vector<std::pair<float, float>> ranges = survivingRanges(curve, a, b, reach);
+        if (ranges.size() == 1 && ranges[0].first == 0.0f && ranges[0].second == float(curve.segmentCount()))
+            continue;  // untouched
+
+        StrokeErase edit;
+        edit.id = id + shift;
+        edit.original = curve;
+        for (const auto& [from, to] : ranges)
+            edit.pieces.push_back(curve.segmentCount() ? sliceCurve(curve, from, to) : curve);
+
+        strokes.erase(strokes.begin() + edit.id);
+        index.erase(edit.id);
+        for (size_t k = 0; k < edit.pieces.size(); ++k) {
+            strokes.insert(strokes.begin() + edit.id + k, edit.pieces[k]);
+            index.insert(edit.id + int(k), edit.pieces[k]);
+        }
+        shift += int(edit.pieces.size()) - 1;
+        edits.push_back(std::move(edit));
+    }
+    return edits;
+}
+
+void StrokeEraser::apply(std::vector<BezierCurve>& strokes, const std::vector<StrokeErase>& edits) {
+    for (const StrokeErase& edit : edits) {
+        strokes.erase(strokes.begin() + edit.id);
+        strokes.insert(strokes.begin() + edit.id, edit.pieces.begin(), edit.pieces.end());
+    }
+}
+
+void StrokeEraser::revert(std::vector<BezierCurve>& strokes, const std::vector<StrokeErase>& edits) {
+    for (auto it = edits.rbegin(); it != edits.rend(); ++it) {
+        auto first = strokes.begin() + it->id;
+        strokes.erase(first, first + it->pieces.size());
+        strokes.insert(strokes.begin() + it->id, it->original);
+    }
+}
+
+} // namespace GameFusion
@@ -0,0 +1,51 @@
+#ifndef STROKEERASER_H
+#define STROKEERASER_H
+
+#include <utility>
+#include <vector>
+#include "BezierCurve.h"
+
+namespace GameFusion {
+
+class StrokeSpatialIndex;
+
+// One stroke replaced by what the eraser left of it. A list of these, applied
+// in order, is the undo record of an erase drag.
+struct StrokeErase {
+    int id = -1;                        // position of the stroke when erased
+    BezierCurve original;
+    std::vector<BezierCurve> pieces;    // in its place, in order; empty when all of it went
+};
+
+// Vector eraser: a round eraser dragged from a to b removes the parts of the
+// strokes whose ink it covers, cutting them where they enter and leave its
+// footprint instead of deleting whole curves.
+//
+// The footprint outline (a capsule, or a circle for a dab) is intersected with
+// each stroke by CurveIntersector, padded by the stroke's half width so the
+// gap left matches the eraser. Only strokes the spatial index finds under the
+// footprint are looked at.
+class StrokeEraser {
+public:
+    // Closed outline of the footprint of an eraser of radius moved from a to b
+    static BezierCurve footprint(const Vector3D& a, const Vector3D& b, float radius);
+
+    // Param ranges of curve (segment index + local t) farther than radius from
+    // the segment a-b, in order. Empty when all of it is covered; a single
+    // dot keeps the range {0, 0} when outside.
+    static std::vector<std::pair<float, float>> survivingRanges(const BezierCurve& curve,
+                                                                const Vector3D& a, const Vector3D& b, float radius);
+
+    // Erase from strokes and index in place. Returns the edits, by increasing
+    // id; the pieces of each are at [id, id + pieces.size()) afterwards.
+    static std::vector<StrokeErase> erase(std::vector<BezierCurve>& strokes, StrokeSpatialIndex& index,
+                                          const Vector3D& a, const Vector3D& b, float radius);
+
+    // Redo and undo of a list of edits on a stroke list
+    static void apply(std::vector<BezierCurve>& strokes, const std::vector<StrokeErase>& edits);
+    static void revert(std::vector<BezierCurve>& strokes, const std::vector<StrokeErase>& edits);
+};
+
+} // namespace GameFusion
+
+#endif // STROKEERASER_H
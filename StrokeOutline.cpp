@@ -0,0 +1,222 @@
+#include "StrokeOutline.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace GameFusion {
+
+namespace {
+
+const float kPi = 3.14159265358979f;
+
+struct OutlinePoint {
+    float x, y;
+    float radius;
+};
+
+// Number of chords needed for a full circle of the given radius so that
+// the chord error stays under tolerance
+int circleSegments(float radius, float tolerance) {
+    if (radius <= tolerance)
+        return 8;
+    float segments = kPi / std::acos(1.0f - tolerance / radius);
+    return std::clamp(static_cast<int>(std::ceil(segments)), 8, 96);
+}
+
+// Append a closed sub-polygon, flipped if needed so every piece of the
+// outline has the same winding direction
+void addOrientedPolygon(QPainterPath& path, std::vector<QPointF>& points) {
+    if (points.size() < 3)
+        return;
+
+    double area = 0.0;
+    for (size_t i = 0, j = points.size() - 1; i < points.size(); j = i++)
+        area += points[j].x() * points[i].y() - points[i].x() * points[j].y();
+    if (std::abs(area) < 1e-9)
+        return;
+    if (area < 0.0)
+        std::reverse(points.begin(), points.end());
+
+    path.moveTo(points[0]);
+    for (size_t i = 1; i < points.size(); ++i)
+        path.lineTo(points[i]);
+    path.closeSubpath();
+}
+
+void addDisc(QPainterPath& path, std::vector<QPointF>& scratch, const OutlinePoint& c, float tolerance) {
+    if (c.radius <= 0.0f)
+        return;
+    int segments = circleSegments(c.radius, tolerance);
+    scratch.clear();
+    for (int i = 0; i < segments; ++i) {
+        float a = 2.0f * kPi * i / segments;
+        scratch.emplace_back(c.x + c.radius * std::cos(a), c.y + c.radius * std::sin(a));
+    }
+    addOrientedPolygon(path, scratch);
+}
+
+} // namespace
+
+std::vector<float> strokeWidths(const std::vector<Vector3D>& vertices,
+                                const std::vector<float>& pressures,
+                                const StrokeProperties& props,
+                                const std::vector<float>& distances) {
+    const size_t n = vertices.size();
+    std::vector<float> widths(n, static_cast<float>(props.maxWidth));
+    if (n == 0)
+        return widths;
+
+    const float minWidth = static_cast<float>(props.minWidth);
+    const float maxWidth = static_cast<float>(props.maxWidth);
+    const bool hasPressures = pressures.size() == n;
+
+    // Arc length at each vertex, so tapers do not depend on vertex spacing
+    std::vector<float> measured;
+    const std::vector<float>* arc = &distances;
+    if (distances.size() != n) {
+        measured.resize(n, 0.0f);
+        for (size_t i = 1; i < n; ++i)
+            measured[i] = measured[i - 1] + std::hypot(vertices[i].x() - vertices[i - 1].x(), vertices[i].y() - vertices[i - 1].y());
+        arc = &measured;
+    }
+    const float total = (*arc)[n - 1] - (*arc)[0];
+
+    for (size_t i = 0; i < n; ++i) {
+        float t = total > 0.0f ? ((*arc)[i] - (*arc)[0]) / total
+                               : (n > 1 ? static_cast<float>(i) / (n - 1) : 0.0f);
+        switch (props.variableWidthMode) {
+        case StrokeProperties::Uniform:
+            break;
+        case StrokeProperties::TaperIn:
+            widths[i] = minWidth + (maxWidth - minWidth) * t;
+            break;
+        case StrokeProperties::TaperOut:
+            widths[i] = maxWidth + (minWidth - maxWidth) * t;
+            break;
+        case StrokeProperties::Pressure:
+            if (hasPressures) {
+                float p = std::clamp(pressures[i], 0.0f, 1.0f);
+                widths[i] = minWidth + (maxWidth - minWidth) * p;
+            } else {
+                // Parabolic fallback if no pressures
+                float tNorm = 2.0f * t - 1.0f;
+                widths[i] = minWidth + (maxWidth - minWidth) * (1.0f - tNorm * tNorm);
+            }
+            break;
+        }
+    }
+    return widths;
+}
+
+QPainterPath buildStrokeOutline(const std::vector<Vector3D>& vertices,
+                                const std::vector<float>& widths,
+                                const StrokeOutlineOptions& options) {
+    QPainterPath path;
+    path.setFillRule(Qt::WindingFill);
+    if (vertices.empty() || widths.size() != vertices.size())
+        return path;
+
+    const float tolerance = std::max(options.tolerance, 0.01f);
+
+    // Drop coincident vertices, keeping the widest radius at each position
+    std::vector<OutlinePoint> points;
+    points.reserve(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        OutlinePoint p{vertices[i].x(), vertices[i].y(), std::max(widths[i], 0.0f) * 0.5f};
+        if (!points.empty()) {
+            OutlinePoint& prev = points.back();
+            float dx = p.x - prev.x;
+            float dy = p.y - prev.y;
+            if (dx * dx + dy * dy < 1e-8f) {
+                prev.radius = std::max(prev.radius, p.radius);
+                continue;
+            }
+        }
+        points.push_back(p);
+    }
+
+    std::vector<QPointF> scratch;
+    scratch.reserve(128);
+
+    if (points.size() == 1) {
+        addDisc(path, scratch, points[0], tolerance);
+        return path;
+    }
+
+    // Segment bodies: one quad per segment, interpolating the half widths
+    std::vector<QPointF> normals(points.size() - 1);
+    for (size_t i = 0; i + 1 < points.size(); ++i) {
+        const OutlinePoint& a = points[i];
+        const OutlinePoint& b = points[i + 1];
+        float dx = b.x - a.x;
+        float dy = b.y - a.y;
+        float len = std::sqrt(dx * dx + dy * dy);
+        QPointF n(-dy / len, dx / len);
+        normals[i] = n;
+
+        scratch.clear();
+        scratch.emplace_back(a.x + n.x() * a.radius, a.y + n.y() * a.radius);
+        scratch.emplace_back(b.x + n.x() * b.radius, b.y + n.y() * b.radius);
+        scratch.emplace_back(b.x - n.x() * b.radius, b.y - n.y() * b.radius);
+        scratch.emplace_back(a.x - n.x() * a.radius, a.y - n.y() * a.radius);
+        addOrientedPolygon(path, scratch);
+    }
+
+    // Joins: fill the wedge left open on the outer side of each turn
+    for (size_t i = 1; i + 1 < points.size(); ++i) {
+        const OutlinePoint& v = points[i];
+        if (v.radius <= 0.0f)
+            continue;
+
+        const QPointF& nIn = normals[i - 1];
+        const QPointF& nOut = normals[i];
+        // Normals turn exactly like the segment directions
+        float cross = static_cast<float>(nIn.x() * nOut.y() - nIn.y() * nOut.x());
+        float dot = static_cast<float>(nIn.x() * nOut.x() + nIn.y() * nOut.y());
+        float angle = std::atan2(std::abs(cross), dot);
+
+        // Gap left between the two quads is below the tolerance
+        if (v.radius * angle < tolerance * 0.5f)
+            continue;
+
+        float side = cross > 0.0f ? -1.0f : 1.0f;
+        QPointF center(v.x, v.y);
+        QPointF a = center + nIn * (side * v.radius);
+        QPointF b = center + nOut * (side * v.radius);
+
+        scratch.clear();
+        scratch.push_back(center);
+        scratch.push_back(a);
+
+        if (options.join == StrokeOutlineOptions::JoinStyle::Miter) {
+            float halfCos = std::cos(angle * 0.5f);
+            if (halfCos > 1e-4f && 1.0f / halfCos <= options.miterLimit) {
+                QPointF m = nIn + nOut;
+                double mLen = std::sqrt(m.x() * m.x() + m.y() * m.y());
+                if (mLen > 1e-9)
+                    scratch.push_back(center + m * (side * v.radius / (halfCos * mLen)));
+            }
+            // else: bevel, the triangle center-a-b
+        } else {
+            float startAngle = std::atan2(static_cast<float>(a.y() - center.y()), static_cast<float>(a.x() - center.x()));
+            float sweep = cross > 0.0f ? angle : -angle;
+            int steps = std::max(1, static_cast<int>(std::ceil(circleSegments(v.radius, tolerance) * angle / (2.0f * kPi))));
+            for (int s = 1; s < steps; ++s) {
+                float t = startAngle + sweep * s / steps;
+                scratch.emplace_back(v.x + v.radius * std::cos(t), v.y + v.radius * std::sin(t));
+            }
+        }
+
+        scratch.push_back(b);
+        addOrientedPolygon(path, scratch);
+    }
+
+    if (options.roundCaps) {
+        addDisc(path, scratch, points.front(), tolerance);
+        addDisc(path, scratch, points.back(), tolerance);
+    }
+
+    return path;
+}
+
+} // namespace GameFusion
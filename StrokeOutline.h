@@ -0,0 +1,43 @@
+#ifndef STROKEOUTLINE_H
+#define STROKEOUTLINE_H
+
+#include <vector>
+#include <QPainterPath>
+#include "StrokeProperties.h"
+#include "Vector3D.h"
+
+namespace GameFusion {
+
+struct StrokeOutlineOptions {
+
+    enum class JoinStyle {
+        Round,          // Circular join on every turn
+        Miter           // Pointed join, falls back to bevel beyond miterLimit
+    };
+
+    JoinStyle join = JoinStyle::Round;
+    float miterLimit = 4.0f;    // Max miter length as a multiple of the half width
+    bool roundCaps = true;      // Round caps at both stroke ends
+    float tolerance = 0.25f;    // Max chord error (px) of generated arcs
+};
+
+// Per-vertex stroke width for the variable width mode of the stroke
+// (pressure track when it matches the vertices, taper ramps otherwise).
+// Tapers run along arc length: distances gives it per vertex, or it is
+// measured along the polyline when empty.
+std::vector<float> strokeWidths(const std::vector<Vector3D>& vertices,
+                                const std::vector<float>& pressures,
+                                const StrokeProperties& props,
+                                const std::vector<float>& distances = std::vector<float>());
+
+// Tessellate a polyline with per-vertex widths into a single filled outline.
+// The outline is a set of consistently oriented sub-polygons (segment quads,
+// joins and caps) meant to be filled with Qt::WindingFill, so overlaps never
+// punch holes and the whole stroke renders as one item with one fill.
+QPainterPath buildStrokeOutline(const std::vector<Vector3D>& vertices,
+                                const std::vector<float>& widths,
+                                const StrokeOutlineOptions& options = StrokeOutlineOptions());
+
+} // namespace GameFusion
+
+#endif // STROKEOUTLINE_H
@@ -0,0 +1,69 @@
+#ifndef STROKESAMPLERING_H
+#define STROKESAMPLERING_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+#include "BezierCurve.h"
+
+namespace GameFusion {
+
+// Fixed-size single-producer / single-consumer ring of pen samples.
+//
+// The GUI thread pushes samples as input events arrive and the stroke worker
+// thread pops them in batches. Neither side locks or allocates: the storage
+// is sized once and head / tail are the only shared state. The capacity is
+// rounded up to a power of two.
+class StrokeSampleRing {
+public:
+    explicit StrokeSampleRing(size_t capacity = 4096) {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        m_samples.resize(size);
+        m_mask = size - 1;
+    }
+
+    StrokeSampleRing(const StrokeSampleRing&) = delete;
+    StrokeSampleRing& operator=(const StrokeSampleRing&) = delete;
+
+    size_t capacity() const { return m_samples.size(); }
+
+    // Producer side. False when the ring is full (the sample is not stored).
+    bool push(const StrokePoint& sample) {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == m_samples.size())
+            return false;
+        m_samples[head & m_mask] = sample;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Copies up to maxCount samples to out, returns the count.
+    size_t pop(StrokePoint* out, size_t maxCount) {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        const size_t available = m_head.load(std::memory_order_acquire) - tail;
+        const size_t count = available < maxCount ? available : maxCount;
+        for (size_t i = 0; i < count; ++i)
+            out[i] = m_samples[(tail + i) & m_mask];
+        m_tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    // Only valid while neither side is running (between strokes)
+    void reset() {
+        m_head.store(0, std::memory_order_relaxed);
+        m_tail.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::vector<StrokePoint> m_samples;
+    size_t m_mask = 0;
+    // Separate cache lines so the two threads do not bounce one line
+    alignas(64) std::atomic<size_t> m_head{0};    // next slot to write
+    alignas(64) std::atomic<size_t> m_tail{0};    // next slot to read
+};
+
+} // namespace GameFusion
+
+#endif // STROKESAMPLERING_H
@@ -0,0 +1,405 @@
+#include "StrokeSpatialIndex.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace GameFusion {
+
+namespace {
+
+// Segments covering more cells than this go to a list scanned on every query
+const int kMaxCellsPerSegment = 1024;
+
+// Chord tolerance (px) used when testing candidates against the curve
+const float kHitTolerance = 0.5f;
+
+// Polyline through a cubic segment with chord error below tolerance; the step
+// count comes from the second differences of the control polygon
+void flatten(const CubicBezier& bez, std::vector<QPointF>& out) {
+    auto secondDiff = [](const Vector3D& a, const Vector3D& b, const Vector3D& c) {
+        float x = a.x() - 2.0f * b.x() + c.x();
+        float y = a.y() - 2.0f * b.y() + c.y();
+        return std::sqrt(x * x + y * y);
+    };
+    float dd = std::max(secondDiff(bez.p0, bez.p1, bez.p2), secondDiff(bez.p1, bez.p2, bez.p3));
+    int steps = std::clamp(static_cast<int>(std::ceil(std::sqrt(0.75f * dd / kHitTolerance))), 1, 256);
+
+    out.clear();
+    for (int i = 0; i <= steps; ++i) {
+        Vector3D p = bez.evaluate(static_cast<float>(i) / steps);
+        out.emplace_back(p.x(), p.y());
+    }
+}
+
+double distanceSquaredToSegment(const QPointF& p, const QPointF& a, const QPointF& b) {
+    const QPointF ab = b - a;
+    const double len2 = ab.x() * ab.x() + ab.y() * ab.y();
+    double t = 0.0;
+    if (len2 > 0.0)
+        t = std::clamp(((p.x() - a.x()) * ab.x() + (p.y() - a.y()) * ab.y()) / len2, 0.0, 1.0);
+    const double dx = a.x() + ab.x() * t - p.x();
+    const double dy = a.y() + ab.y() * t - p.y();
+    return dx * dx + dy * dy;
+}
+
+double distanceToPolyline(const QPointF& p, const std::vector<QPointF>& points) {
+    double best = std::numeric_limits<double>::max();
+    if (points.size() == 1)
+        best = distanceSquaredToSegment(p, points[0], points[0]);
+    for (size_t i = 0; i + 1 < points.size(); ++i)
+        best = std::min(best, distanceSquaredToSegment(p, points[i], points[i + 1]));
+    return std::sqrt(best);
+}
+
+// Liang-Barsky clip of the chord a-b against rect
+bool chordIntersectsRect(const QPointF& a, const QPointF& b, const QRectF& rect) {
+    double t0 = 0.0, t1 = 1.0;
+    const double dx = b.x() - a.x();
+    const double dy = b.y() - a.y();
+    const double p[4] = {-dx, dx, -dy, dy};
+    const double q[4] = {a.x() - rect.left(), rect.right() - a.x(), a.y() - rect.top(), rect.bottom() - a.y()};
+    for (int i = 0; i < 4; ++i) {
+        if (p[i] == 0.0) {
+            if (q[i] < 0.0)
+                return false;
+            continue;
+        }
+        double r = q[i] / p[i];
+        if (p[i] < 0.0)
+            t0 = std::max(t0, r);
+        else
+            t1 = std::min(t1, r);
+        if (t0 > t1)
+            return false;
+    }
+    return true;
+}
+
+double cross(const QPointF& o, const QPointF& a, const QPointF& b) {
+    return (a.x() - o.x()) * (b.y() - o.y()) - (a.y() - o.y()) * (b.x() - o.x());
+}
+
+// Chords a-b and c-d cross or touch
+bool chordsIntersect(const QPointF& a, const QPointF& b, const QPointF& c, const QPointF& d) {
+    const double d1 = cross(c, d, a), d2 = cross(c, d, b);
+    const double d3 = cross(a, b, c), d4 = cross(a, b, d);
+    if (((d1 > 0.0 && d2 < 0.0) || (d1 < 0.0 && d2 > 0.0)) && ((d3 > 0.0 && d4 < 0.0) || (d3 < 0.0 && d4 > 0.0)))
+        return true;
+    // Collinear or end point on the other chord
+    return distanceSquaredToSegment(a, c, d) == 0.0 || distanceSquaredToSegment(b, c, d) == 0.0
+        || distanceSquaredToSegment(c, a, b) == 0.0 || distanceSquaredToSegment(d, a, b) == 0.0;
+}
+
+// Chord a-b crosses an edge of polygon or passes within reach of one
+bool chordTouchesPolygonEdge(const QPointF& a, const QPointF& b, const QPolygonF& polygon, double reach) {
+    const double reach2 = reach * reach;
+    for (int i = 0; i < polygon.size(); ++i) {
+        const QPointF& c = polygon[i];
+        const QPointF& d = polygon[(i + 1) % polygon.size()];
+        if (chordsIntersect(a, b, c, d))
+            return true;
+        if (reach > 0.0
+            && std::min(std::min(distanceSquaredToSegment(a, c, d), distanceSquaredToSegment(b, c, d)),
+                        std::min(distanceSquaredToSegment(c, a, b), distanceSquaredToSegment(d, a, b))) <= reach2)
+            return true;
+    }
+    return false;
+}
+
+BBox boxAround(const QRectF& rect) {
+    BBox box;
+    box.minX = static_cast<float>(rect.left());
+    box.maxX = static_cast<float>(rect.right());
+    box.minY = static_cast<float>(rect.top());
+    box.maxY = static_cast<float>(rect.bottom());
+    return box;
+}
+
+} // namespace
+
+StrokeSpatialIndex::StrokeSpatialIndex(float cellSize)
+    : m_cellSize(std::max(cellSize, 1.0f)) {}
+
+void StrokeSpatialIndex::clear() {
+    m_segments.clear();
+    m_freeSlots.clear();
+    m_strokes.clear();
+    m_cells.clear();
+    m_oversized.clear();
+    m_visited.clear();
+}
+
+void StrokeSpatialIndex::build(const std::vector<BezierCurve>& strokes) {
+    clear();
+    m_strokes.resize(strokes.size());
+    for (size_t i = 0; i < strokes.size(); ++i)
+        addSegments(static_cast<int>(i), strokes[i]);
+}
+
+void StrokeSpatialIndex::insert(int id, const BezierCurve& curve) {
+    m_strokes.insert(m_strokes.begin() + id, StrokeEntry());
+    renumber(id + 1);
+    addSegments(id, curve);
+}
+
+void StrokeSpatialIndex::update(int id, const BezierCurve& curve) {
+    removeSegments(id);
+    addSegments(id, curve);
+}
+
+void StrokeSpatialIndex::erase(int id) {
+    removeSegments(id);
+    m_strokes.erase(m_strokes.begin() + id);
+    renumber(id);
+}
+
+int StrokeSpatialIndex::cellIndex(float v) const {
+    double c = std::floor(v / m_cellSize);
+    return static_cast<int>(std::clamp(c, -1.0e9, 1.0e9));
+}
+
+void StrokeSpatialIndex::addSegments(int id, const BezierCurve& curve) {
+    StrokeEntry& entry = m_strokes[id];
+    entry.segments.clear();
+    entry.bounds = QRectF();
+
+    const float halfWidth = static_cast<float>(curve.getStrokeProperties().maxWidth) * 0.5f;
+
+    auto addSegment = [&](const CubicBezier& bez) {
+        int slot;
+        if (!m_freeSlots.empty()) {
+            slot = m_freeSlots.back();
+            m_freeSlots.pop_back();
+        } else {
+            slot = static_cast<int>(m_segments.size());
+            m_segments.emplace_back();
+        }
+
+        Segment& seg = m_segments[slot];
+        seg.stroke = id;
+        seg.index = static_cast<int>(entry.segments.size());
+        seg.bezier = bez;
+        seg.halfWidth = halfWidth;
+        seg.box = getBBox(bez);
+        seg.box.minX -= halfWidth;
+        seg.box.minY -= halfWidth;
+        seg.box.maxX += halfWidth;
+        seg.box.maxY += halfWidth;
+        entry.segments.push_back(slot);
+        entry.bounds = entry.bounds.united(QRectF(QPointF(seg.box.minX, seg.box.minY), QPointF(seg.box.maxX, seg.box.maxY)));
+
+        const int cx0 = cellIndex(seg.box.minX), cx1 = cellIndex(seg.box.maxX);
+        const int cy0 = cellIndex(seg.box.minY), cy1 = cellIndex(seg.box.maxY);
+        if (qint64(cx1 - cx0 + 1) * (cy1 - cy0 + 1) > kMaxCellsPerSegment) {
+            m_oversized.push_back(slot);
+            return;
+        }
+        for (int cy = cy0; cy <= cy1; ++cy)
+            for (int cx = cx0; cx <= cx1; ++cx)
+                m_cells[cellKey(cx, cy)].push_back(slot);
+    };
+
+    if (curve.size() == 1) {
+        // A single handle is a dot; index it as a degenerate segment
+        const Vector3D& p = curve[0].point;
+        addSegment(CubicBezier{p, p, p, p});
+        return;
+    }
+    for (int i = 0; i < curve.segmentCount(); ++i)
+        addSegment(curve.segment(i));
+}
+
+void StrokeSpatialIndex::removeSegments(int id) {
+    auto removeFrom = [](std::vector<int>& slots, int slot) {
+        auto it = std::find(slots.begin(), slots.end(), slot);
+        if (it != slots.end()) {
+            *it = slots.back();
+            slots.pop_back();
+        }
+    };
+
+    StrokeEntry& entry = m_strokes[id];
+    for (int slot : entry.segments) {
+        Segment& seg = m_segments[slot];
+        const int cx0 = cellIndex(seg.box.minX), cx1 = cellIndex(seg.box.maxX);
+        const int cy0 = cellIndex(seg.box.minY), cy1 = cellIndex(seg.box.maxY);
+        if (qint64(cx1 - cx0 + 1) * (cy1 - cy0 + 1) > kMaxCellsPerSegment) {
+            removeFrom(m_oversized, slot);
+        } else {
+            for (int cy = cy0; cy <= cy1; ++cy) {
+                for (int cx = cx0; cx <= cx1; ++cx) {
+                    auto cell = m_cells.find(cellKey(cx, cy));
+                    if (cell == m_cells.end())
+                        continue;
+                    removeFrom(cell.value(), slot);
+                    if (cell.value().empty())
+                        m_cells.erase(cell);
+                }
+            }
+        }
+        seg.stroke = -1;
+        m_freeSlots.push_back(slot);
+    }
+    entry.segments.clear();
+    entry.bounds = QRectF();
+}
+
+void StrokeSpatialIndex::renumber(int from) {
+    for (int id = from; id < size(); ++id) {
+        for (int slot : m_strokes[id].segments)
+            m_segments[slot].stroke = id;
+    }
+}
+
+template <typename Fn>
+void StrokeSpatialIndex::forEachCandidate(const BBox& query, Fn fn) const {
+    if (m_visited.size() < m_segments.size())
+        m_visited.resize(m_segments.size(), 0);
+    if (++m_queryStamp == 0) {
+        std::fill(m_visited.begin(), m_visited.end(), 0);
+        m_queryStamp = 1;
+    }
+
+    auto visit = [&](int slot) {
+        if (m_visited[slot] == m_queryStamp)
+            return;
+        m_visited[slot] = m_queryStamp;
+        const Segment& seg = m_segments[slot];
+        if (seg.stroke >= 0 && seg.box.overlaps(query))
+            fn(seg);
+    };
+
+    const int cx0 = cellIndex(query.minX), cx1 = cellIndex(query.maxX);
+    const int cy0 = cellIndex(query.minY), cy1 = cellIndex(query.maxY);
+    if (qint64(cx1 - cx0 + 1) * (cy1 - cy0 + 1) > m_cells.size()) {
+        // Query larger than the populated area: walk the cells instead
+        for (auto it = m_cells.cbegin(); it != m_cells.cend(); ++it) {
+            for (int slot : it.value())
+                visit(slot);
+        }
+    } else {
+        for (int cy = cy0; cy <= cy1; ++cy) {
+            for (int cx = cx0; cx <= cx1; ++cx) {
+                auto it = m_cells.constFind(cellKey(cx, cy));
+                if (it == m_cells.cend())
+                    continue;
+                for (int slot : it.value())
+                    visit(slot);
+            }
+        }
+    }
+    for (int slot : m_oversized)
+        visit(slot);
+}
+
+std::vector<int> StrokeSpatialIndex::queryRect(const QRectF& rect) const {
+    std::vector<int> result;
+    const QRectF query = rect.normalized();
+    if (query.isNull() || m_strokes.empty())
+        return result;
+
+    std::vector<bool> hit(m_strokes.size(), false);
+    std::vector<QPointF> points;
+
+    forEachCandidate(boxAround(query), [&](const Segment& seg) {
+        if (hit[seg.stroke])
+            return;
+        const QRectF padded = query.adjusted(-seg.halfWidth, -seg.halfWidth, seg.halfWidth, seg.halfWidth);
+        flatten(seg.bezier, points);
+        bool touches = padded.contains(points[0]);
+        for (size_t i = 0; !touches && i + 1 < points.size(); ++i)
+            touches = chordIntersectsRect(points[i], points[i + 1], padded);
+        if (touches) {
+            hit[seg.stroke] = true;
+            result.push_back(seg.stroke);
+        }
+    });
+
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+std::vector<std::pair<int, int>> StrokeSpatialIndex::querySegments(const BBox& box) const {
+    std::vector<std::pair<int, int>> result;
+    if (m_strokes.empty())
+        return result;
+    forEachCandidate(box, [&](const Segment& seg) {
+        result.emplace_back(seg.stroke, seg.index);
+    });
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+std::vector<int> StrokeSpatialIndex::queryPolygon(const QPolygonF& polygon) const {
+    std::vector<int> result;
+    if (polygon.size() < 3 || m_strokes.empty())
+        return result;
+
+    std::vector<bool> hit(m_strokes.size(), false);
+    std::vector<QPointF> points;
+
+    // As queryRect: the ink touches the lasso if the centre line starts inside
+    // it, or any chord crosses an edge or comes within half the stroke width
+    // of one. A polyline that crosses no edge lies wholly inside or outside.
+    forEachCandidate(boxAround(polygon.boundingRect()), [&](const Segment& seg) {
+        if (hit[seg.stroke])
+            return;
+        flatten(seg.bezier, points);
+        bool touches = polygon.containsPoint(points[0], Qt::OddEvenFill);
+        for (size_t i = 0; !touches && i + 1 < points.size(); ++i)
+            touches = chordTouchesPolygonEdge(points[i], points[i + 1], polygon, seg.halfWidth);
+        if (touches) {
+            hit[seg.stroke] = true;
+            result.push_back(seg.stroke);
+        }
+    });
+
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+std::vector<int> StrokeSpatialIndex::queryRadius(const QPointF& point, float radius) const {
+    std::vector<int> result;
+    if (m_strokes.empty())
+        return result;
+
+    std::vector<bool> hit(m_strokes.size(), false);
+    std::vector<QPointF> points;
+    const QRectF area(point.x() - radius, point.y() - radius, 2.0 * radius, 2.0 * radius);
+
+    forEachCandidate(boxAround(area), [&](const Segment& seg) {
+        if (hit[seg.stroke])
+            return;
+        flatten(seg.bezier, points);
+        if (distanceToPolyline(point, points) - seg.halfWidth <= radius) {
+            hit[seg.stroke] = true;
+            result.push_back(seg.stroke);
+        }
+    });
+
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+int StrokeSpatialIndex::nearest(const QPointF& point, float radius, float* distance) const {
+    int best = -1;
+    double bestDistance = radius;
+    std::vector<QPointF> points;
+    const QRectF area(point.x() - radius, point.y() - radius, 2.0 * radius, 2.0 * radius);
+
+    forEachCandidate(boxAround(area), [&](const Segment& seg) {
+        flatten(seg.bezier, points);
+        double d = std::max(0.0, distanceToPolyline(point, points) - seg.halfWidth);
+        // Ties go to the stroke on top (highest id)
+        if (d < bestDistance || (d == bestDistance && seg.stroke > best)) {
+            bestDistance = d;
+            best = seg.stroke;
+        }
+    });
+
+    if (distance && best >= 0)
+        *distance = static_cast<float>(bestDistance);
+    return best;
+}
+
+} // namespace GameFusion
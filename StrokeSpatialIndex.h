@@ -0,0 +1,98 @@
+#ifndef STROKESPATIALINDEX_H
+#define STROKESPATIALINDEX_H
+
+#include <utility>
+#include <vector>
+#include <QHash>
+#include <QPointF>
+#include <QPolygonF>
+#include <QRectF>
+#include "BezierCurve.h"
+
+namespace GameFusion {
+
+// Uniform grid over the cubic segments of a layer's strokes, used for
+// hit-testing, rubber band / lasso selection and erasing.
+//
+// Stroke ids are positions in the layer's stroke vector and follow it:
+// insert() and erase() shift the ids after them exactly like std::vector, so
+// the index stays in step with Layer::strokes without a rebuild. Cells hold
+// segment bounding boxes from the analytic getBBox, padded by half the
+// stroke width; candidates are then tested against the flattened segment.
+class StrokeSpatialIndex {
+public:
+    explicit StrokeSpatialIndex(float cellSize = 128.0f);
+
+    void clear();
+
+    // Rebuild from a whole stroke list
+    void build(const std::vector<BezierCurve>& strokes);
+
+    // Stroke added at position id (ids >= id move up by one)
+    void insert(int id, const BezierCurve& curve);
+    // Stroke geometry or width changed
+    void update(int id, const BezierCurve& curve);
+    // Stroke removed from position id (ids > id move down by one)
+    void erase(int id);
+
+    int size() const { return static_cast<int>(m_strokes.size()); }
+    QRectF strokeBounds(int id) const { return m_strokes[id].bounds; }
+
+    // Strokes whose ink touches rect / lies partly inside polygon, in id order
+    std::vector<int> queryRect(const QRectF& rect) const;
+    std::vector<int> queryPolygon(const QPolygonF& polygon) const;
+
+    // Strokes whose ink passes within radius of point, in id order
+    std::vector<int> queryRadius(const QPointF& point, float radius) const;
+
+    // Segments whose padded boxes overlap box, as (stroke id, segment index)
+    // pairs in id order; no geometry test. Broad phase for CurveIntersector.
+    std::vector<std::pair<int, int>> querySegments(const BBox& box) const;
+    const CubicBezier& segment(int id, int index) const { return m_segments[m_strokes[id].segments[index]].bezier; }
+
+    // Closest stroke whose ink passes within radius of point, -1 if none.
+    // distance receives the gap between the point and the stroke edge.
+    int nearest(const QPointF& point, float radius, float* distance = nullptr) const;
+
+private:
+    struct Segment {
+        int stroke = -1;        // -1 for free slots
+        int index = 0;          // segment within the stroke
+        CubicBezier bezier;
+        BBox box;               // padded by halfWidth
+        float halfWidth = 0.0f;
+    };
+
+    struct StrokeEntry {
+        std::vector<int> segments;  // slots in m_segments
+        QRectF bounds;
+    };
+
+    static quint64 cellKey(int cx, int cy) {
+        return (quint64(quint32(cx)) << 32) | quint32(cy);
+    }
+    int cellIndex(float v) const;
+
+    void addSegments(int id, const BezierCurve& curve);
+    void removeSegments(int id);
+    // Stroke ids from position from onwards moved: restamp their segments
+    void renumber(int from);
+
+    // Visit every segment whose box overlaps the query box once
+    template <typename Fn> void forEachCandidate(const BBox& query, Fn fn) const;
+
+    float m_cellSize;
+    std::vector<Segment> m_segments;
+    std::vector<int> m_freeSlots;
+    std::vector<StrokeEntry> m_strokes;
+    QHash<quint64, std::vector<int>> m_cells;
+    std::vector<int> m_oversized;   // segments spanning too many cells to bucket
+
+    // Per-query visit marks, so segments listed in several cells are tested once
+    mutable std::vector<unsigned> m_visited;
+    mutable unsigned m_queryStamp = 0;
+};
+
+} // namespace GameFusion
+
+#endif // STROKESPATIALINDEX_H
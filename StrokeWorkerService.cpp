@@ -0,0 +1,253 @@
+#include "StrokeWorkerService.h"
+
+#include "BezierCurve.h"
+
+#include <QGuiApplication>
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QScreen>
+#include <algorithm>
+
+namespace {
+
+// Samples taken from the ring per pop
+const size_t kDrainBatch = 64;
+
+// RMS distance of the samples from the fitted curve, in pixels, past which the
+// open segment is closed
+const double kFitTolerance = 1.0;
+
+// Display refresh assumed when the screen does not report one
+const double kDefaultRefreshRate = 60.0;
+
+} // namespace
+
+StrokeWorkerService::StrokeWorkerService(QObject* parent, int threadCount)
+    : QObject(parent) {
+    const QScreen* screen = QGuiApplication::primaryScreen();
+    const double refreshRate = screen && screen->refreshRate() > 0.0 ? screen->refreshRate() : kDefaultRefreshRate;
+    m_frameTimer = new QTimer(this);
+    m_frameTimer->setTimerType(Qt::PreciseTimer);
+    m_frameTimer->setInterval(std::max(1, int(1000.0 / refreshRate)));
+    connect(m_frameTimer, &QTimer::timeout, this, &StrokeWorkerService::deliverAll);
+
+    threadCount = std::max(1, threadCount);
+    for (int i = 0; i < threadCount; ++i) {
+        QThread* thread = new QThread(this);
+        thread->setObjectName(QString("StrokeWorker%1").arg(i));
+        thread->start();
+        QObject* context = new QObject;
+        context->moveToThread(thread);
+        m_threads.append(thread);
+        m_contexts.append(context);
+        m_load.append(0);
+    }
+}
+
+StrokeWorkerService::~StrokeWorkerService() {
+    // Work still queued for open sessions is dropped with the threads' event
+    // loops; the contexts go once nothing can run on them
+    for (QThread* thread : m_threads) {
+        thread->quit();
+        thread->wait();
+    }
+    m_sessions.clear();
+    qDeleteAll(m_contexts);
+}
+
+StrokeWorkerService::Channel* StrokeWorkerService::acquireChannel() {
+    if (!m_freeChannels.isEmpty())
+        return m_freeChannels.takeLast();
+    m_channels.push_back(std::make_unique<Channel>());
+    return m_channels.back().get();
+}
+
+void StrokeWorkerService::releaseChannel(Channel* channel) {
+    channel->samples.reset();
+    channel->drainPending.store(false);
+    channel->fitter.reset();
+    channel->pointCount = 0;
+    channel->fit = StrokeFit();
+    channel->fitFirstHandle = 0;
+    channel->deliveredHandles = 0;
+    channel->hasResult = false;
+    channel->completedFinal = false;
+    channel->handlesBefore = 0;
+    channel->handlesAfter = 0;
+    m_freeChannels.append(channel);
+}
+
+int StrokeWorkerService::beginStroke(const StrokeProperties& props, const ResultFunction& onResult) {
+    Session session;
+    session.timer.start();
+    session.onResult = onResult;
+    session.channel = acquireChannel();
+    session.thread = int(std::min_element(m_load.begin(), m_load.end()) - m_load.begin());
+    ++m_load[session.thread];
+
+    Channel* channel = session.channel;
+    channel->fitter.setTolerance(kFitTolerance);
+    channel->props = props;
+    channel->simplifyTolerance = m_simplifyTolerance;
+
+    const int stroke = m_nextStroke++;
+    if (m_nextStroke <= 0)
+        m_nextStroke = 1;
+    m_sessions.insert(stroke, session);
+    if (!m_frameTimer->isActive())
+        m_frameTimer->start();
+    return stroke;
+}
+
+void StrokeWorkerService::addSample(int stroke, const GameFusion::StrokePoint& sample) {
+    auto it = m_sessions.constFind(stroke);
+    if (it == m_sessions.constEnd() || it->ending)
+        return;
+
+    Channel* channel = it->channel;
+    if (!channel->samples.push(sample))
+        ++m_droppedSamples;  // a drain is already queued
+    else if (!channel->drainPending.exchange(true, std::memory_order_acq_rel))
+        QMetaObject::invokeMethod(m_contexts[it->thread], [channel]() { drain(channel); }, Qt::QueuedConnection);
+}
+
+void StrokeWorkerService::endStroke(int stroke) {
+    auto it = m_sessions.find(stroke);
+    if (it == m_sessions.end() || it->ending)
+        return;
+    it->ending = true;
+
+    // Queued behind the pending drain, so no sample is lost. Nothing is
+    // queued for the channel after this, so the session can end with it.
+    Channel* channel = it->channel;
+    QMetaObject::invokeMethod(m_contexts[it->thread], [this, stroke, channel]() {
+        drain(channel);
+        publish(channel, true);
+        QMetaObject::invokeMethod(this, [this, stroke]() { endSession(stroke); }, Qt::QueuedConnection);
+    }, Qt::QueuedConnection);
+}
+
+void StrokeWorkerService::drain(Channel* channel) {
+    // Cleared first: a sample pushed from here on queues the next drain
+    channel->drainPending.store(false, std::memory_order_release);
+
+    GameFusion::StrokePoint batch[kDrainBatch];
+    size_t count;
+    size_t drained = 0;
+    while ((count = channel->samples.pop(batch, kDrainBatch)) > 0) {
+        for (size_t i = 0; i < count; ++i)
+            channel->fitter.addPoint(batch[i]);
+        drained += count;
+    }
+    channel->pointCount += int(drained);
+    if (drained > 0)
+        publish(channel, false);
+}
+
+void StrokeWorkerService::publish(Channel* channel, bool completedFinal) {
+    const GameFusion::StreamingCurveFitter& fitter = channel->fitter;
+    if (!completedFinal) {
+        // Copied under the lock, since what the GUI thread already has decides
+        // where it starts: the last handle it got, whose right control was
+        // still open then
+        QMutexLocker lock(&channel->mutex);
+        if (channel->completedFinal)
+            return;
+        const int first = std::max(channel->deliveredHandles - 1, 0);
+        channel->fit.pointIndex = channel->pointCount;
+        channel->fit.finalized = fitter.finalizedCurve(first);
+        channel->fit.finalized.setStrokeProperties(channel->props);
+        channel->fit.open = fitter.openCurve();
+        channel->fit.open.setStrokeProperties(channel->props);
+        channel->fitFirstHandle = first;
+        channel->hasResult = true;
+        return;
+    }
+
+    StrokeFit fit;
+    fit.pointIndex = channel->pointCount;
+    fit.finalized = fitter.curve();
+    fit.finalized.setStrokeProperties(channel->props);
+    const bool isSimplified = channel->simplifyTolerance > 0.0;
+    const int handlesBefore = fit.finalized.size();
+    if (isSimplified)
+        fit.finalized = GameFusion::simplifyStroke(fit.finalized, channel->simplifyTolerance);
+
+    QMutexLocker lock(&channel->mutex);
+    channel->handlesBefore = isSimplified ? handlesBefore : 0;
+    channel->handlesAfter = isSimplified ? fit.finalized.size() : 0;
+    channel->fit = std::move(fit);
+    channel->fitFirstHandle = 0;
+    channel->completedFinal = true;
+    channel->hasResult = true;
+}
+
+void StrokeWorkerService::deliverAll() {
+    // Copied: a callback may end or begin sessions
+    const QList<int> strokes = m_sessions.keys();
+    for (int stroke : strokes)
+        deliver(stroke);
+}
+
+void StrokeWorkerService::deliver(int stroke) {
+    auto it = m_sessions.find(stroke);
+    if (it == m_sessions.end())
+        return;
+
+    Channel* channel = it->channel;
+    StrokeFit fit;
+    bool completedFinal = false;
+    int handlesBefore = 0;
+    int handlesAfter = 0;
+    {
+        QMutexLocker lock(&channel->mutex);
+        if (!channel->hasResult)
+            return;  // nothing new since the previous frame
+        fit = std::move(channel->fit);
+        channel->fit = StrokeFit();
+        if (!fit.finalized.empty())
+            channel->deliveredHandles = channel->fitFirstHandle + fit.finalized.size();
+        completedFinal = channel->completedFinal;
+        handlesBefore = channel->handlesBefore;
+        handlesAfter = channel->handlesAfter;
+        channel->hasResult = false;
+        channel->completedFinal = false;
+    }
+
+    if (completedFinal && handlesBefore > 0) {
+        ++m_simplify.strokes;
+        m_simplify.handlesBefore += handlesBefore;
+        m_simplify.handlesAfter += handlesAfter;
+        emit strokeSimplified(handlesBefore, handlesAfter);
+    }
+
+    if (!it->firstCurve) {
+        it->firstCurve = true;
+        const double ms = it->timer.nsecsElapsed() / 1.0e6;
+        m_latency.lastMs = ms;
+        m_latency.minMs = m_latency.strokes ? std::min(m_latency.minMs, ms) : ms;
+        m_latency.maxMs = std::max(m_latency.maxMs, ms);
+        m_latency.totalMs += ms;
+        ++m_latency.strokes;
+        emit firstCurveLatency(ms);
+    }
+
+    // Copied: the callback may start a new session and rehash m_sessions
+    const ResultFunction onResult = it->onResult;
+    if (onResult)
+        onResult(fit, completedFinal);
+}
+
+void StrokeWorkerService::endSession(int stroke) {
+    // The final fit may still be waiting for the next frame
+    deliver(stroke);
+
+    auto it = m_sessions.find(stroke);
+    if (it == m_sessions.end())
+        return;
+    --m_load[it->thread];
+    releaseChannel(it->channel);
+    m_sessions.erase(it);
+    if (m_sessions.isEmpty())
+        m_frameTimer->stop();
+}
@@ -0,0 +1,171 @@
+#ifndef STROKEWORKERSERVICE_H
+#define STROKEWORKERSERVICE_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "StrokeProperties.h"
+#include "StrokeSampleRing.h"
+#include "StreamingCurveFitter.h"
+
+// Long-lived threads that fit pen strokes while they are drawn.
+//
+// The threads are started once, with the canvas, so pen-down only picks the
+// least busy one instead of spawning and tearing down a QThread per stroke.
+// Each stroke is one session, named by an id; its work runs on the thread
+// through a context object living there, and the session ends once the final
+// curve has been handed over.
+//
+// Pen samples travel to the worker thread through a lock-free ring. A drain
+// is queued on the worker thread only when the ring goes from idle to
+// non-empty, so a 1 kHz pen costs one event per batch instead of one per
+// sample. The drain feeds the session's StreamingCurveFitter, which only
+// re-solves the open segment, and a preview only carries what changed since
+// the GUI thread last took one: the newly finalized segments and the open
+// one. So a preview costs the same at the end of a long stroke as at its
+// start. Fitted curves come back the same way: the drain overwrites a
+// per-session mailbox, which the GUI thread empties on a timer at the
+// display refresh rate, so it wakes at most once per frame however fast the
+// pen reports.
+//
+// The service also times every session from pen-down to the first fitted
+// curve reaching the GUI thread.
+//
+// Finished strokes are simplified on the worker thread before they are
+// handed over (simplifyStroke, within a pixel tolerance), and the handle
+// counts before and after are added up so the savings can be reported.
+class StrokeWorkerService : public QObject {
+    Q_OBJECT
+public:
+    struct LatencyStats {
+        int strokes = 0;
+        double lastMs = 0.0;
+        double minMs = 0.0;
+        double maxMs = 0.0;
+        double totalMs = 0.0;
+        double averageMs() const { return strokes ? totalMs / strokes : 0.0; }
+    };
+
+    struct SimplifyStats {
+        int strokes = 0;
+        qint64 handlesBefore = 0;
+        qint64 handlesAfter = 0;
+        double savedRatio() const { return handlesBefore ? 1.0 - double(handlesAfter) / handlesBefore : 0.0; }
+    };
+
+    // A fit handed to the GUI thread. A preview holds the segments finalized
+    // since the previous one, starting at the handle they continue from, and
+    // the open segment, which replaces the previous open segment. The final
+    // fit is the whole (simplified) stroke in finalized.
+    struct StrokeFit {
+        int pointIndex = 0;                 // samples the fit covers
+        GameFusion::BezierCurve finalized;
+        GameFusion::BezierCurve open;
+    };
+
+    // Called on the GUI thread with the newest fit of a session, at most once
+    // a frame. No finalized segment is skipped; the final fit never is.
+    using ResultFunction = std::function<void(const StrokeFit& fit, bool completedFinal)>;
+
+    explicit StrokeWorkerService(QObject* parent = nullptr, int threadCount = 2);
+    ~StrokeWorkerService() override;
+
+    // Start a stroke session on the least busy thread; returns its id, never 0
+    int beginStroke(const StrokeProperties& props, const ResultFunction& onResult);
+
+    // GUI thread only. Samples that do not fit in the ring are dropped and
+    // counted; samples after endStroke() are ignored.
+    void addSample(int stroke, const GameFusion::StrokePoint& sample);
+
+    // Pen up: the remaining samples are drained and the final curve handed
+    // over, which ends the session
+    void endStroke(int stroke);
+
+    int activeSessions() const { return m_sessions.size(); }
+    int droppedSamples() const { return m_droppedSamples; }
+    const LatencyStats& latencyStats() const { return m_latency; }
+
+    // Deviation allowed when simplifying a finished stroke, in pixels; 0
+    // commits strokes as fitted. Applies to strokes begun afterwards.
+    void setSimplifyTolerance(double pixels) { m_simplifyTolerance = std::max(0.0, pixels); }
+    double simplifyTolerance() const { return m_simplifyTolerance; }
+    const SimplifyStats& simplifyStats() const { return m_simplify; }
+    void resetSimplifyStats() { m_simplify = SimplifyStats(); }
+
+signals:
+    // Pen-down to first curve of a session, in milliseconds
+    void firstCurveLatency(double milliseconds);
+    // A finished stroke was simplified from handlesBefore to handlesAfter
+    void strokeSimplified(int handlesBefore, int handlesAfter);
+
+private:
+    // State shared by the GUI thread and a session's worker thread. Channels
+    // are reused across sessions once nothing is queued for them any more.
+    struct Channel {
+        GameFusion::StrokeSampleRing samples;
+        std::atomic<bool> drainPending{false};
+
+        // Worker thread only
+        GameFusion::StreamingCurveFitter fitter;
+        StrokeProperties props;
+        int pointCount = 0;         // samples fed to the fitter
+        double simplifyTolerance = 0.0;
+
+        QMutex mutex;               // guards the result mailbox
+        StrokeFit fit;
+        int fitFirstHandle = 0;     // stroke index of fit.finalized[0]
+        int deliveredHandles = 0;   // finalized handles the GUI thread has
+        bool hasResult = false;
+        bool completedFinal = false;
+        int handlesBefore = 0;      // of the final curve, 0 if not simplified
+        int handlesAfter = 0;
+    };
+
+    struct Session {
+        Channel* channel = nullptr;
+        ResultFunction onResult;
+        int thread = 0;
+        bool ending = false;        // endStroke() was called
+        bool firstCurve = false;
+        QElapsedTimer timer;
+    };
+
+    // Worker thread: fit everything in the ring and publish the preview
+    static void drain(Channel* channel);
+    // Worker thread: park a fit in the mailbox for the next frame. The final
+    // fit is simplified first.
+    static void publish(Channel* channel, bool completedFinal);
+
+    // GUI thread, once per frame: hand the newest fit of every session over
+    void deliverAll();
+    void deliver(int stroke);
+    void endSession(int stroke);
+    Channel* acquireChannel();
+    void releaseChannel(Channel* channel);
+
+    QVector<QThread*> m_threads;
+    QVector<QObject*> m_contexts;           // per thread, runs the sessions' work
+    QTimer* m_frameTimer = nullptr;         // runs while there are sessions
+    QVector<int> m_load;                    // active sessions per thread
+    QHash<int, Session> m_sessions;
+    int m_nextStroke = 1;
+    std::vector<std::unique_ptr<Channel>> m_channels;
+    QVector<Channel*> m_freeChannels;
+    int m_droppedSamples = 0;
+    LatencyStats m_latency;
+    double m_simplifyTolerance = 0.5;
+    SimplifyStats m_simplify;
+};
+
+#endif // STROKEWORKERSERVICE_H
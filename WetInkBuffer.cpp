@@ -0,0 +1,197 @@
+#include "WetInkBuffer.h"
+
+#include <QPainter>
+#include <QPen>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Predicted ink never reaches further than this from the last sample (px)
+const qreal kMaxPredictionDistance = 48.0;
+
+QPen inkPen(const QColor& color, qreal width) {
+    return QPen(color, width, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
+}
+
+} // namespace
+
+WetInkBuffer::WetInkBuffer()
+    : m_latencies(kLatencyHistory) {
+    m_samples.reserve(4096);
+    m_unpresented.reserve(256);
+    m_latencyScratch.reserve(kLatencyHistory);
+}
+
+void WetInkBuffer::resize(const QSize& size, qreal devicePixelRatio) {
+    if (size.isEmpty()) {
+        m_image = QImage();
+        return;
+    }
+    m_image = QImage(size * devicePixelRatio, QImage::Format_ARGB32_Premultiplied);
+    m_image.setDevicePixelRatio(devicePixelRatio);
+    redraw();
+}
+
+void WetInkBuffer::begin(const QTransform& sceneToView) {
+    m_sceneToView = sceneToView;
+    m_viewScale = std::sqrt(std::abs(sceneToView.determinant()));
+    clear();
+}
+
+void WetInkBuffer::clear() {
+    m_samples.clear();
+    m_firstIndex = 0;
+    m_lastPredictionRect = QRect();
+    if (!m_image.isNull())
+        m_image.fill(Qt::transparent);
+}
+
+qreal WetInkBuffer::penWidth(float pressure) const {
+    return std::max<qreal>(1.0, m_props.maxWidth * pressure * m_viewScale);
+}
+
+QRect WetInkBuffer::segmentRect(const QPointF& a, const QPointF& b, qreal width) const {
+    const qreal pad = width * 0.5 + 2.0;
+    return QRectF(a, b).normalized().adjusted(-pad, -pad, pad, pad).toAlignedRect();
+}
+
+QRect WetInkBuffer::paintSegment(int index) {
+    if (m_image.isNull()) return QRect();
+
+    const Sample& sample = m_samples[index];
+    const QPointF b = toView(sample.scenePos);
+    const QPointF a = index > 0 ? toView(m_samples[index - 1].scenePos) : b;
+    const qreal width = penWidth(sample.pressure);
+
+    QPainter p(&m_image);
+    p.setRenderHint(QPainter::Antialiasing, true);
+    p.setPen(inkPen(m_props.foregroundColor, width));
+    if (index > 0)
+        p.drawLine(a, b);
+    else
+        p.drawPoint(b);
+    return segmentRect(a, b, width);
+}
+
+QRect WetInkBuffer::redraw() {
+    if (m_image.isNull()) return QRect();
+    m_image.fill(Qt::transparent);
+    for (int i = 0; i < int(m_samples.size()); ++i)
+        paintSegment(i);
+    return QRect(QPoint(0, 0), m_image.size() / m_image.devicePixelRatio());
+}
+
+QRect WetInkBuffer::addSample(const GameFusion::StrokePoint& point, qint64 arrivalNs, const QTransform& sceneToView) {
+    Sample sample;
+    sample.scenePos = point.pos;
+    sample.pressure = point.pressure;
+    sample.timestamp = point.timestamp;
+    m_samples.push_back(sample);
+    m_unpresented.push_back(arrivalNs);
+
+    QRect dirty;
+    if (sceneToView != m_sceneToView) {
+        // Zoomed or scrolled mid-stroke: the whole tail moved
+        m_sceneToView = sceneToView;
+        m_viewScale = std::sqrt(std::abs(sceneToView.determinant()));
+        dirty = redraw();
+    } else {
+        dirty = paintSegment(int(m_samples.size()) - 1);
+    }
+
+    // The old prediction is erased by the repaint, the new one drawn by it
+    const QRect prediction = predictionRect();
+    dirty = dirty.united(m_lastPredictionRect).united(prediction);
+    m_lastPredictionRect = prediction;
+    return dirty;
+}
+
+QRect WetInkBuffer::trimTo(int pointIndex) {
+    // The sample at pointIndex stays as the start of the remaining tail
+    const int drop = std::min(pointIndex - m_firstIndex, int(m_samples.size()) - 1);
+    if (drop <= 0)
+        return QRect();
+    m_samples.erase(m_samples.begin(), m_samples.begin() + drop);
+    m_firstIndex += drop;
+    return redraw();
+}
+
+std::vector<QPointF> WetInkBuffer::predictedPoints() const {
+    std::vector<QPointF> points;
+    const size_t n = m_samples.size();
+    if (!m_predict || n < 3 || m_predictionMs <= 0.0f)
+        return points;
+
+    const Sample& s0 = m_samples[n - 3];
+    const Sample& s1 = m_samples[n - 2];
+    const Sample& s2 = m_samples[n - 1];
+    const qint64 dt1 = s1.timestamp - s0.timestamp;
+    const qint64 dt2 = s2.timestamp - s1.timestamp;
+    if (dt1 <= 0 || dt2 <= 0)
+        return points;  // no usable timing (synthetic events)
+
+    // Average velocity of the last two segments, in view px per ms
+    const QPointF p0 = toView(s0.scenePos);
+    const QPointF p1 = toView(s1.scenePos);
+    const QPointF p2 = toView(s2.scenePos);
+    const QPointF velocity = ((p1 - p0) / qreal(dt1) + (p2 - p1) / qreal(dt2)) * 0.5;
+
+    QPointF ahead = velocity * qreal(m_predictionMs);
+    const qreal distance = std::hypot(ahead.x(), ahead.y());
+    if (distance < 0.5)
+        return points;
+    if (distance > kMaxPredictionDistance)
+        ahead *= kMaxPredictionDistance / distance;
+
+    points.push_back(p2 + ahead * 0.5);
+    points.push_back(p2 + ahead);
+    return points;
+}
+
+QRect WetInkBuffer::predictionRect() const {
+    const std::vector<QPointF> points = predictedPoints();
+    if (points.empty())
+        return QRect();
+    const qreal width = penWidth(m_samples.back().pressure);
+    QRect rect = segmentRect(toView(m_samples.back().scenePos), points.front(), width);
+    return rect.united(segmentRect(points.front(), points.back(), width));
+}
+
+void WetInkBuffer::paint(QPainter& painter, const QRect& rect) const {
+    if (m_image.isNull() || m_samples.empty()) return;
+
+    painter.save();
+    painter.setClipRect(rect);
+    painter.drawImage(QPointF(0, 0), m_image);
+
+    const std::vector<QPointF> points = predictedPoints();
+    if (!points.empty()) {
+        painter.setRenderHint(QPainter::Antialiasing, true);
+        painter.setPen(inkPen(m_props.foregroundColor, penWidth(m_samples.back().pressure)));
+        QPointF from = toView(m_samples.back().scenePos);
+        for (const QPointF& to : points) {
+            painter.drawLine(from, to);
+            from = to;
+        }
+    }
+    painter.restore();
+}
+
+void WetInkBuffer::presented(qint64 presentNs) {
+    for (qint64 arrival : m_unpresented) {
+        m_latencies[m_latencyNext] = float((presentNs - arrival) / 1.0e6);
+        m_latencyNext = (m_latencyNext + 1) % kLatencyHistory;
+        m_latencyCount = std::min(m_latencyCount + 1, kLatencyHistory);
+    }
+    m_unpresented.clear();
+}
+
+double WetInkBuffer::latencyPercentile(double percentile) const {
+    if (m_latencyCount == 0)
+        return 0.0;
+    m_latencyScratch.assign(m_latencies.begin(), m_latencies.begin() + m_latencyCount);
+    const int index = std::clamp(int(percentile * (m_latencyCount - 1) + 0.5), 0, m_latencyCount - 1);
+    std::nth_element(m_latencyScratch.begin(), m_latencyScratch.begin() + index, m_latencyScratch.end());
+    return m_latencyScratch[index];
+}
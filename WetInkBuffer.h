@@ -0,0 +1,109 @@
+#ifndef WETINKBUFFER_H
+#define WETINKBUFFER_H
+
+#include <QColor>
+#include <QImage>
+#include <QPointF>
+#include <QRect>
+#include <QSize>
+#include <QTransform>
+#include <QVector>
+#include <vector>
+
+#include "BezierCurve.h"
+#include "StrokeProperties.h"
+
+class QPainter;
+
+// Wet ink of the stroke being drawn, kept in a persistent viewport sized
+// image. Every new pen sample paints only its own segment into the image, so
+// the cost per sample does not grow with the stroke.
+//
+// Samples are kept in scene coordinates: when the worker reports that a prefix
+// of the stroke has been fitted (and is drawn by the scene), the image is
+// redrawn from the unfitted tail only, and a view transform change mid-stroke
+// redraws it the same way.
+//
+// Optionally the ink runs ahead of the pen by a few predicted points
+// extrapolated from the recent velocity. They are drawn on top of the image at
+// paint time and never stored, so a wrong guess is gone on the next frame.
+//
+// Latency is measured per sample from its arrival at the canvas to the end of
+// the first paint that shows it.
+class WetInkBuffer {
+public:
+    WetInkBuffer();
+
+    void setStrokeProperties(const StrokeProperties& props) { m_props = props; }
+
+    // Viewport size in device independent pixels
+    void resize(const QSize& size, qreal devicePixelRatio);
+
+    // Start a stroke; its samples are numbered from 0 like the worker's points
+    void begin(const QTransform& sceneToView);
+    void clear();
+    bool isEmpty() const { return m_samples.empty(); }
+
+    // Append a sample that arrived at arrivalNs (QElapsedTimer clock) and
+    // return the viewport rect to repaint
+    QRect addSample(const GameFusion::StrokePoint& sample, qint64 arrivalNs, const QTransform& sceneToView);
+
+    // Samples up to pointIndex are drawn by the fitted curve now; the image
+    // is rebuilt from the rest. Returns the rect to repaint.
+    QRect trimTo(int pointIndex);
+
+    void setPredictionEnabled(bool enabled) { m_predict = enabled; }
+    // How far ahead the predicted points reach, in ms
+    void setPredictionMs(float ms) { m_predictionMs = ms; }
+
+    // Draw the ink and the predicted points intersecting rect
+    void paint(QPainter& painter, const QRect& rect) const;
+
+    // Call at the end of a paint: samples shown for the first time get their
+    // latency recorded
+    void presented(qint64 presentNs);
+
+    // Input to present latency over the recent samples, in ms
+    double latencyPercentile(double percentile) const;
+    double latencyP50() const { return latencyPercentile(0.5); }
+    double latencyP99() const { return latencyPercentile(0.99); }
+    int latencySampleCount() const { return m_latencyCount; }
+
+private:
+    struct Sample {
+        QPointF scenePos;
+        float pressure = 1.0f;
+        qint64 timestamp = 0;   // ms, input event time
+    };
+
+    static const int kLatencyHistory = 2048;
+
+    QPointF toView(const QPointF& scenePos) const { return m_sceneToView.map(scenePos); }
+    qreal penWidth(float pressure) const;
+    QRect segmentRect(const QPointF& a, const QPointF& b, qreal width) const;
+    QRect paintSegment(int index);
+    QRect redraw();
+    // Predicted view points after the last sample, empty when off or unsure
+    std::vector<QPointF> predictedPoints() const;
+    QRect predictionRect() const;
+
+    StrokeProperties m_props;
+    QImage m_image;
+    QTransform m_sceneToView;
+    qreal m_viewScale = 1.0;
+
+    std::vector<Sample> m_samples;  // unfitted tail of the stroke
+    int m_firstIndex = 0;           // stroke index of m_samples[0]
+
+    bool m_predict = true;
+    float m_predictionMs = 12.0f;
+    QRect m_lastPredictionRect;
+
+    std::vector<qint64> m_unpresented;              // arrival times
+    QVector<float> m_latencies;                     // ring, ms
+    int m_latencyNext = 0;
+    int m_latencyCount = 0;
+    mutable std::vector<float> m_latencyScratch;
+};
+
+#endif // WETINKBUFFER_H
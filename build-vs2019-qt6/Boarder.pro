@@ -251,6 +251,18 @@ HEADERS += ../StrokeAttributeDockWidget.h
 SOURCES += ../BezierCurve.cpp
 HEADERS += ../BezierCurve.h ../StrokeProperties.h
 
+SOURCES += ../BezierFlatten.cpp
+HEADERS += ../BezierFlatten.h
+
+SOURCES += ../StrokeOutline.cpp
+HEADERS += ../StrokeOutline.h
+SOURCES += ../StrokeSpatialIndex.cpp
+HEADERS += ../StrokeSpatialIndex.h
+SOURCES += ../CurveIntersector.cpp
+HEADERS += ../CurveIntersector.h
+SOURCES += ../StrokeEraser.cpp
+HEADERS += ../StrokeEraser.h
+
 SOURCES += ../OptionsDialog.cpp
 HEADERS += ../OptionsDialog.h
 
@@ -271,6 +283,25 @@ HEADERS += ../ColorPaletteWidget.h
 SOURCES += ../PaintCanvas.cpp
 HEADERS += ../PaintCanvas.h
 
+SOURCES += ../LayerTileCache.cpp
+HEADERS += ../LayerTileCache.h
+
+SOURCES += ../StreamingCurveFitter.cpp
+HEADERS += ../StreamingCurveFitter.h
+SOURCES += ../StrokeWorkerService.cpp
+HEADERS += ../StrokeWorkerService.h ../StrokeSampleRing.h
+
+SOURCES += ../WetInkBuffer.cpp
+HEADERS += ../WetInkBuffer.h
+SOURCES += ../BezierHandleItem.cpp
+HEADERS += ../BezierHandleItem.h
+SOURCES += ../LayerCompositor.cpp
+HEADERS += ../LayerCompositor.h
+SOURCES += ../OnionSkinCache.cpp
+HEADERS += ../OnionSkinCache.h
+SOURCES += ../LayerSourceStore.cpp
+HEADERS += ../LayerSourceStore.h
+
 # Input source files
 SOURCES +=  \
            $$GF/Applications/TimeLineProject/TimeLineView.cpp \